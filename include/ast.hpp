@@ -4,239 +4,141 @@
 // Includes
 
 #include "tokens.hpp"
+#include <cstdint>
 #include <memory>
-#include <optional>
+#include <span>
+#include <string>
 #include <vector>
 
-// Statement
-
-enum class StmtType {
+// Node
+//
+// A parsed program is a flat arena of fixed size nodes that refer to their children by 32 bit
+// index. Variable length children, such as the statements of a block, live in the arena's list
+// pool as a count followed by the child indices. Nodes are only ever appended, so an index stays
+// valid for the lifetime of the arena and releasing a program frees a handful of vectors.
+//
+// Fields by node type:
+//
+//   var_decl     a: identifier, b: value
+//   fn_decl      a: identifier, b: body, c: parameter list, d: scope
+//   while_loop   a: body
+//   import       a: argument
+//   push, type   a: operand
+//   ternary      a: left, b: right
+//   call         op: 'tail_call' in tail position of a reusable frame, a: callee, c: argument list,
+//                d: call site index set by the resolver
+//   command      op: Type, a: repeat count or 'no_node'
+//   fused        op: Fusion, a and b: low and high half of the operand
+//   identifier   a: symbol, b and c: depth and slot set by the resolver, 'no_node' when looked up by name
+//   number       a and b: low and high half of the value
+//   string       a: string index
+//   array        c: element list
+//   program      c: statement list, d: scope or 'no_node' when the block runs in the enclosing one
+
+using NodeId = std::uint32_t;
+constexpr NodeId no_node = 0xffffffff;
+
+enum class StmtType : std::uint8_t {
    var_decl, fn_decl, while_loop, import,
    break_stmt, continue_stmt,
-   ternary, call, command, push, type, pull,
+   ternary, call, command, fused, push, type, pull,
    identifier, number, string, array, program
 };
 
-struct Statement;
-using Stmt = std::shared_ptr<Statement>;
-
-struct Statement {
+struct Node {
    StmtType type;
+   std::uint8_t op = 0;
+   std::uint16_t reserved = 0;
+   std::uint32_t a = no_node, b = no_node, c = no_node, d = no_node;
 
-   Statement(StmtType type)
-      : type(type) {}
-   virtual ~Statement() = default;
-};
-
-// Statements
+   // Accessors for the fields that do not hold a node index
 
-// Variable declaration statement
-
-struct VarDecl : public Statement {
-   Stmt identifier, value;
-
-   VarDecl(Stmt identifier, Stmt value)
-      : identifier(identifier), value(value), Statement(StmtType::var_decl) {}
-      
-   static Stmt make(Stmt identifier, Stmt value) {
-      return std::make_shared<VarDecl>(std::move(identifier), std::move(value));
-   }   
-};
-
-// Function declaration statement
-
-struct FnDecl : public Statement {
-   Stmt identifier, body;
-   std::vector<Stmt> args;
-
-   FnDecl(Stmt identifier, Stmt body, std::vector<Stmt> args)
-      : identifier(identifier), body(body), args(args), Statement(StmtType::fn_decl) {}
-   
-   static Stmt make(Stmt identifier, Stmt body, std::vector<Stmt> args) {
-      return std::make_shared<FnDecl>(std::move(identifier), std::move(body), std::move(args));
+   long number() const {
+      return long(std::uint64_t(a) | std::uint64_t(b) << 32);
    }
-};
-
-// While loop statement
-
-struct WhileLoop : public Statement {
-   Stmt body;
 
-   WhileLoop(Stmt body)
-      : body(body), Statement(StmtType::while_loop) {}
-   
-   static Stmt make(Stmt body) {
-      return std::make_shared<WhileLoop>(std::move(body));
+   void set_number(long number) {
+      a = std::uint32_t(std::uint64_t(number));
+      b = std::uint32_t(std::uint64_t(number) >> 32);
    }
-};
-
-// Import statement
-
-struct ImportStmt : public Statement {
-   Stmt import;
-
-   ImportStmt(Stmt import)
-      : import(import), Statement(StmtType::import) {}
-   
-   static Stmt make(Stmt import) {
-      return std::make_shared<ImportStmt>(std::move(import));
-   }
-};
 
-// Break statement
-
-struct BreakStmt : public Statement {
-   BreakStmt() : Statement(StmtType::break_stmt) {}
-   static Stmt make() { return std::make_shared<BreakStmt>(); }
-};
-
-// Continue statement
-
-struct ContinueStmt : public Statement {
-   ContinueStmt() : Statement(StmtType::continue_stmt) {}
-   static Stmt make() { return std::make_shared<ContinueStmt>(); }
+   int depth() const { return int(b); }
+   int slot() const { return int(c); }
 };
 
-// Push statement
-
-struct PushStmt : public Statement {
-   Stmt stmt;
-
-   PushStmt(Stmt stmt)
-      : stmt(stmt), Statement(StmtType::push) {}
-   
-   static Stmt make(Stmt stmt) {
-      return std::make_shared<PushStmt>(stmt);
-   }
-};
+static_assert(sizeof(Node) == 20);
 
-// Type statement
+constexpr std::uint8_t tail_call = 1;
 
-struct TypeStmt : public Statement {
-   Stmt stmt;
+// Fused command
+//
+// Produced by the fuser from two adjacent statements, either two commands or a pushed number
+// literal followed by a command. The operand holds the literal for the push forms.
 
-   TypeStmt(Stmt stmt)
-      : stmt(stmt), Statement(StmtType::type) {}
-   
-   static Stmt make(Stmt stmt) {
-      return std::make_shared<TypeStmt>(stmt);
-   }
+enum class Fusion : std::uint8_t {
+   dup_multiply, swap_subtract, equal_not,
+   push_add, push_subtract, push_multiply, push_divide, push_modulo,
+   push_equal, push_less, push_greater
 };
 
-// Pull statement
+// Ast
 
-struct PullStmt : public Statement {
-   PullStmt() : Statement(StmtType::pull) {}
-   static Stmt make() { return std::make_shared<PullStmt>(); }
-};
+struct Bundle;
+struct Scope;
 
-// Expressions
+// 'bundle' holds the modules embedded in the program image the arena was loaded from, if any,
+// which its imports find before the file system
 
-// Ternary expression
+struct Ast : public std::enable_shared_from_this<Ast> {
+   std::vector<Node> nodes;
+   std::vector<std::uint32_t> lists;
+   std::vector<std::string> strings;
+   std::vector<std::shared_ptr<Scope>> scopes;
+   std::uint32_t call_sites = 0;
+   NodeId root = no_node;
+   std::shared_ptr<const Bundle> bundle;
 
-struct TernaryExpr : public Statement {
-   Stmt left, right;
+   const Node& operator[](NodeId id) const { return nodes[id]; }
+   Node& operator[](NodeId id) { return nodes[id]; }
 
-   TernaryExpr(Stmt left, Stmt right)
-      : left(left), right(right), Statement(StmtType::ternary) {}
-   
-   static Stmt make(Stmt left, Stmt right) {
-      return std::make_shared<TernaryExpr>(std::move(left), std::move(right));
+   NodeId id(const Node& node) const {
+      return &node - nodes.data();
    }
-};
-
-// Call expression
-
-struct CallExpr : public Statement {
-   Stmt identifier;
-   std::vector<Stmt> args;
 
-   CallExpr(Stmt identifier, std::vector<Stmt> args)
-      : identifier(identifier), args(args), Statement(StmtType::call) {}
-   
-   static Stmt make(Stmt identifier, std::vector<Stmt> args) {
-      return std::make_shared<CallExpr>(std::move(identifier), std::move(args));
+   std::span<const NodeId> list(std::uint32_t offset) const {
+      return {lists.data() + offset + 1, lists[offset]};
    }
-};
-
-// Command call expression
-
-struct Command : public Statement {
-   Type op;
-   std::optional<Stmt> right;
 
-   Command(Type op, std::optional<Stmt> right)
-      : op(op), right(right), Statement(StmtType::command) {}
-   
-   static Stmt make(Type op, std::optional<Stmt> right) {
-      return std::make_shared<Command>(op, right);
+   std::span<NodeId> list(std::uint32_t offset) {
+      return {lists.data() + offset + 1, lists[offset]};
    }
-};
-
-// Literals
-
-// Identifier literal
 
-struct IdentLiteral : public Statement {
-   std::string identifier;
-
-   IdentLiteral(const std::string& identifier)
-      : identifier(identifier), Statement(StmtType::identifier) {}
-   
-   static Stmt make(const std::string& identifier) {
-      return std::make_shared<IdentLiteral>(identifier);
+   const Scope* scope(std::uint32_t index) const {
+      return (index == no_node ? nullptr : scopes[index].get());
    }
-};
-
-// Number literal
 
-struct NumberLiteral : public Statement {
-   long number;
+   // Builder functions
 
-   NumberLiteral(long number)
-      : number(number), Statement(StmtType::number) {}
-   
-   static Stmt make(long number) {
-      return std::make_shared<NumberLiteral>(number);
+   NodeId add(const Node& node) {
+      nodes.push_back(node);
+      return nodes.size() - 1;
    }
-};
-
-// String literal
-
-struct StringLiteral : public Statement {
-   std::string string;
 
-   StringLiteral(const std::string& string)
-      : string(string), Statement(StmtType::string) {}
-   
-   static Stmt make(const std::string& string) {
-      return std::make_shared<StringLiteral>(string);
+   std::uint32_t add_list(const std::vector<NodeId>& children) {
+      auto offset = lists.size();
+      lists.push_back(children.size());
+      lists.insert(lists.end(), children.begin(), children.end());
+      return offset;
    }
-};
-
-// Array literal
-
-struct ArrayLiteral : public Statement {
-   std::vector<Stmt> stmts;
 
-   ArrayLiteral(std::vector<Stmt> stmts)
-      : stmts(stmts), Statement(StmtType::array) {}
-   
-   static Stmt make(std::vector<Stmt> stmts) {
-      return std::make_shared<ArrayLiteral>(std::move(stmts));
+   std::uint32_t add_string(std::string string) {
+      strings.push_back(std::move(string));
+      return strings.size() - 1;
    }
-};
-
-// Program
-
-struct Program : public Statement {
-   std::vector<Stmt> stmts;
 
-   Program(std::vector<Stmt> stmts)
-      : stmts(stmts), Statement(StmtType::program) {}
-   
-   static Stmt make(std::vector<Stmt> stmts) {
-      return std::make_shared<Program>(std::move(stmts));
+   std::uint32_t add_scope(std::shared_ptr<Scope> scope) {
+      scopes.push_back(std::move(scope));
+      return scopes.size() - 1;
    }
 };
 
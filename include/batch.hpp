@@ -0,0 +1,21 @@
+#ifndef BATCH_HPP
+#define BATCH_HPP
+
+// Includes
+
+#include "mei.hpp"
+#include <string>
+
+// Batch
+//
+// Runs every job of a list file on a pool of threads, one interpreter instance per thread. Each
+// line of the list names a script and optionally a file that the script reads as its input.
+// Scripts with the same source are parsed once and shared by all of their jobs. Once every job is
+// done their output is written in list order, followed by the error of a job that failed.
+// Returns the status of the first failed job in the list, 0 when all of them succeeded.
+
+namespace batch {
+   int run(const std::string& list, const mei::Options& options, unsigned threads);
+}
+
+#endif
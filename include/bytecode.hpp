@@ -0,0 +1,82 @@
+#ifndef BYTECODE_HPP
+#define BYTECODE_HPP
+
+// Includes
+
+#include "values.hpp"
+#include <cstdint>
+
+// Opcodes
+//
+// The list is kept as an X macro so that the VM's dispatch table always matches the enum order.
+
+#define MEI_OPCODES(X) \
+   /* Values */ \
+   X(push_const) X(push_nil) X(pop) X(drop) X(load) X(load_slot) X(define) X(define_slot) \
+   X(make_fn) X(make_array) \
+   /* Scopes and control flow */ \
+   X(enter_scope) X(exit_scope) X(loop_enter) X(loop_exit) X(loop_test) X(branch) X(jump) \
+   X(break_dyn) X(continue_dyn) X(call) X(tail_call) X(import) X(ret) X(error) \
+   /* Statements */ \
+   X(push) X(type) X(pull) \
+   /* Commands */ \
+   X(read_number) X(read_key) X(logical_not) X(exit) X(drop_stack) X(modulo) X(square_root) \
+   X(read_line) X(multiply) X(subtract) X(add) X(equal) X(swap) X(duplicate) X(negate) \
+   X(print_char) X(less) X(greater) X(print_number) X(divide) X(size) X(set_register) \
+   X(get_register) X(logical_or) X(logical_and) X(unknown) \
+   /* Fused commands */ \
+   X(dup_multiply) X(swap_subtract) X(equal_not) X(push_add) X(push_subtract) X(push_multiply) \
+   X(push_divide) X(push_modulo) X(push_equal) X(push_less) X(push_greater)
+
+enum class Op : std::uint8_t {
+#define MEI_OPCODE(name) name,
+   MEI_OPCODES(MEI_OPCODE)
+#undef MEI_OPCODE
+   count
+};
+
+// Instruction
+//
+// Command opcodes use 'a' as a flag telling whether the repeat count ('X') has been pushed to the
+// value stack and 'b' as a flag telling whether the result value is discarded. Fused command
+// opcodes use 'a' for the pushed literal instead. Slot opcodes use 'a' and 'b' for the resolved
+// depth and slot and 'c' for the symbol.
+
+struct Instruction {
+   Op op;
+   std::int32_t a = 0, b = 0, c = 0;
+};
+
+// Flow handler
+//
+// Describes where a 'Break' or 'Continue' raised inside a call or an import lands when the call
+// site is lexically inside a loop of the calling chunk.
+
+struct Handler {
+   std::int32_t depth, scopes;
+   std::int32_t break_target, continue_target;
+};
+
+// Chunk
+
+struct FnProto;
+
+struct Chunk {
+   std::shared_ptr<const Bundle> bundle;
+   std::vector<Instruction> code;
+   std::vector<Value> constants;
+   std::vector<std::shared_ptr<Scope>> scopes;
+   std::vector<Handler> handlers;
+   std::vector<std::unique_ptr<FnProto>> functions;
+};
+
+// Function prototype
+
+struct FnProto {
+   Symbol identifier;
+   std::vector<Symbol> params;
+   std::shared_ptr<Scope> scope;
+   Chunk chunk;
+};
+
+#endif
@@ -0,0 +1,301 @@
+#ifndef COMMANDS_HPP
+#define COMMANDS_HPP
+
+// Includes
+
+#include "stack.hpp"
+#include "tokens.hpp"
+#include "values.hpp"
+#include <cmath>
+
+// Commands
+//
+// Every stack command is implemented once here and shared by the tree walker and the VM. Each
+// function performs a single execution of the command and returns its result value.
+
+namespace command {
+   // Input and output commands
+
+   Value read_number();
+   Value read_key();
+   Value read_line();
+   Value print_char();
+   Value print_number();
+   [[noreturn]] void exit();
+   [[noreturn]] void unknown(Type op);
+
+   // Helper functions
+
+   void push_to_stack(Value value);
+   [[noreturn]] void expected_values(const char* op, int count);
+   [[noreturn]] void division_by_zero();
+
+   // Stack commands
+   //
+   // Each command checks the stack depth once and then works on the buffer in place.
+
+   inline Value logical_not() {
+      if (stack::empty()) {
+         expected_values("!", 1);
+      }
+      stack::replace_top(!stack::peek(0));
+      return NumberValue::make(stack::peek(0));
+   }
+
+   inline Value drop() {
+      return NumberValue::make(stack::pop());
+   }
+
+   inline Value modulo() {
+      if (stack::size() < 2) {
+         expected_values("%", 2);
+      }
+      long a = stack::peek(0), b = stack::peek(1);
+      if (a == 0) {
+         division_by_zero();
+      }
+      long result = b % a;
+      stack::drop(1);
+      stack::replace_top(result);
+      return NumberValue::make(result);
+   }
+
+   inline Value square_root() {
+      if (stack::empty()) {
+         expected_values("^", 1);
+      }
+      long result = std::sqrt(stack::peek(0));
+      stack::replace_top(result);
+      return NumberValue::make(result);
+   }
+
+   inline Value multiply() {
+      if (stack::size() < 2) {
+         expected_values("*", 2);
+      }
+      long result = stack::peek(0) * stack::peek(1);
+      stack::drop(1);
+      stack::replace_top(result);
+      return NumberValue::make(result);
+   }
+
+   inline Value subtract() {
+      if (stack::size() < 2) {
+         expected_values("-", 2);
+      }
+      long result = stack::peek(1) - stack::peek(0);
+      stack::drop(1);
+      stack::replace_top(result);
+      return NumberValue::make(result);
+   }
+
+   inline Value add() {
+      if (stack::size() < 2) {
+         expected_values("+", 2);
+      }
+      long result = stack::peek(0) + stack::peek(1);
+      stack::drop(1);
+      stack::replace_top(result);
+      return NumberValue::make(result);
+   }
+
+   inline Value equal() {
+      if (stack::size() < 2) {
+         expected_values("=", 2);
+      }
+      bool result = stack::peek(0) == stack::peek(1);
+      stack::drop(1);
+      stack::replace_top(result);
+      return NumberValue::make(result);
+   }
+
+   inline Value swap() {
+      if (stack::size() < 2) {
+         long a = stack::pop(), b = stack::pop();
+         stack::push(a);
+         stack::push(b);
+         return NumberValue::make(b);
+      }
+
+      long a, b;
+      stack::pop2(a, b);
+      stack::push(a);
+      stack::push(b);
+      return NumberValue::make(b);
+   }
+
+   inline Value duplicate() {
+      long value = stack::top();
+      stack::push(value);
+      return NumberValue::make(value);
+   }
+
+   inline Value negate() {
+      if (stack::empty()) {
+         expected_values("'", 1);
+      }
+      stack::replace_top(-stack::peek(0));
+      return NumberValue::make(stack::peek(0));
+   }
+
+   inline Value less() {
+      if (stack::size() < 2) {
+         expected_values("<", 2);
+      }
+      long result = stack::peek(0) > stack::peek(1);
+      stack::drop(1);
+      stack::replace_top(result);
+      return NumberValue::make(result);
+   }
+
+   inline Value greater() {
+      if (stack::size() < 2) {
+         expected_values(">", 2);
+      }
+      long result = stack::peek(0) < stack::peek(1);
+      stack::drop(1);
+      stack::replace_top(result);
+      return NumberValue::make(result);
+   }
+
+   inline Value divide() {
+      if (stack::size() < 2) {
+         expected_values("/", 2);
+      }
+      long a = stack::peek(0), b = stack::peek(1);
+      if (a == 0) {
+         division_by_zero();
+      }
+      long result = b / a;
+      stack::drop(1);
+      stack::replace_top(result);
+      return NumberValue::make(result);
+   }
+
+   inline Value size() {
+      long size = stack::size();
+      stack::push(size);
+      return NumberValue::make(size);
+   }
+
+   inline Value set_register() {
+      if (stack::size() < 2) {
+         long value = stack::pop();
+         return NumberValue::make(value);
+      }
+
+      long value, index;
+      stack::pop2(value, index);
+      reg::set(index, value);
+      return NumberValue::make(value);
+   }
+
+   inline Value get_register() {
+      if (stack::empty()) {
+         stack::push(0);
+         return NumberValue::make(0);
+      }
+
+      long value = reg::get(stack::peek(0));
+      stack::replace_top(value);
+      return NumberValue::make(value);
+   }
+
+   // The logical commands only pop their second operand when the first one does not decide the
+   // result, matching the short circuit of the original 'pop() || pop()'
+
+   inline Value logical_or() {
+      if (stack::size() < 2) {
+         expected_values("||", 2);
+      }
+
+      if (!stack::peek(0)) {
+         stack::drop(1);
+      }
+      long result = stack::peek(0) != 0;
+      stack::replace_top(result);
+      return NumberValue::make(result);
+   }
+
+   inline Value logical_and() {
+      if (stack::size() < 2) {
+         expected_values("&&", 2);
+      }
+
+      if (stack::peek(0)) {
+         stack::drop(1);
+      }
+      long result = stack::peek(0) != 0;
+      stack::replace_top(result);
+      return NumberValue::make(result);
+   }
+
+   // Fused commands
+   //
+   // Each fused command runs two commands in one step. When the stack is too shallow for the fast
+   // path, or the fast path would divide by zero, it runs the two commands one after the other so
+   // that the result and any error message stay the same.
+
+   inline Value dup_multiply() {
+      if (stack::empty()) {
+         duplicate();
+         return multiply();
+      }
+      long result = stack::peek(0) * stack::peek(0);
+      stack::replace_top(result);
+      return NumberValue::make(result);
+   }
+
+   inline Value swap_subtract() {
+      if (stack::size() < 2) {
+         swap();
+         return subtract();
+      }
+      long result = stack::peek(0) - stack::peek(1);
+      stack::drop(1);
+      stack::replace_top(result);
+      return NumberValue::make(result);
+   }
+
+   inline Value equal_not() {
+      if (stack::size() < 2) {
+         equal();
+         return logical_not();
+      }
+      long result = stack::peek(0) != stack::peek(1);
+      stack::drop(1);
+      stack::replace_top(result);
+      return NumberValue::make(result);
+   }
+
+#define MEI_PUSH_FUSION(name, function, guard, expression) \
+   inline Value name(long n) {                            \
+      if (stack::empty() || !(guard)) {                   \
+         stack::push(n);                                  \
+         return function();                               \
+      }                                                   \
+      long b = stack::peek(0);                            \
+      long result = (expression);                         \
+      stack::replace_top(result);                         \
+      return NumberValue::make(result);                   \
+   }
+
+   MEI_PUSH_FUSION(push_add, add, true, b + n)
+   MEI_PUSH_FUSION(push_subtract, subtract, true, b - n)
+   MEI_PUSH_FUSION(push_multiply, multiply, true, n * b)
+   MEI_PUSH_FUSION(push_divide, divide, n != 0, b / n)
+   MEI_PUSH_FUSION(push_modulo, modulo, n != 0, b % n)
+   MEI_PUSH_FUSION(push_equal, equal, true, n == b)
+   MEI_PUSH_FUSION(push_less, less, true, n > b)
+   MEI_PUSH_FUSION(push_greater, greater, true, n < b)
+
+#undef MEI_PUSH_FUSION
+
+   // Dispatch
+
+   Value execute(Type op);
+   Value repeat(Type op, long times);
+   Value execute(Fusion fusion, long operand);
+}
+
+#endif
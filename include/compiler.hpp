@@ -0,0 +1,62 @@
+#ifndef COMPILER_HPP
+#define COMPILER_HPP
+
+// Includes
+
+#include "bytecode.hpp"
+
+// Compiler
+//
+// Lowers a parsed program into a linear chunk of bytecode for the VM. The compiler tracks the
+// depth of the value stack statically so that 'Break' and 'Continue' can unwind it with a single
+// jump instead of polling flags after every statement.
+
+class Compiler {
+   struct Loop {
+      int depth, scopes;
+      std::int32_t top;
+      std::vector<std::size_t> breaks;
+      std::vector<std::int32_t> handlers;
+   };
+
+   Chunk& chunk;
+   const Ast& ast;
+   std::vector<Loop> loops;
+   int depth = 0, scopes = 0;
+
+   // Compile functions
+
+   void compile_stmt(const Node& node, bool keep);
+   void compile_block(std::span<const NodeId> stmts, bool keep);
+   void compile_var_decl(const Node& decl);
+   void compile_fn_decl(const Node& decl);
+   void compile_while_loop(const Node& whl);
+   void compile_break(bool is_break);
+   void compile_call_expr(const Node& call);
+   void compile_identifier(const Node& ident);
+   void compile_define(const Node& ident);
+   void compile_command(const Node& command, bool keep);
+   void compile_fused_command(const Node& fused, bool keep);
+   void compile_ternary_expr(const Node& ternary, bool keep);
+
+   // Helper functions
+
+   std::size_t emit(Op op, std::int32_t a = 0, std::int32_t b = 0, std::int32_t c = 0);
+   std::int32_t here() const;
+   std::int32_t handler();
+   std::int32_t add_constant(Value value);
+   void error(const std::string& message);
+
+public:
+   Compiler(Chunk& chunk, const Ast& ast);
+
+   void compile();
+   void compile_body(NodeId body);
+};
+
+// Helper functions
+
+Op command_op(Type type);
+Op fused_op(Fusion fusion);
+
+#endif
@@ -4,21 +4,61 @@
 // Includes
 
 #include "values.hpp"
-#include <unordered_map>
+
+// Scope
+//
+// Static layout of an environment computed by the resolver: every name declared in the scope gets
+// a slot index. Names the resolver cannot see, such as those introduced by 'Import', still live
+// in the environment's symbol map.
+
+struct Scope {
+   std::vector<Symbol> names;
+   SymbolMap<int> slots;
+
+   int declare(Symbol name);
+   int add(Symbol name);
+   int find(Symbol name) const;
+};
 
 // Environment
+//
+// Every change to the bindings of an environment gives it a new revision. Revisions are unique
+// within a thread, so an (environment, revision) pair identifies one state of one environment even
+// when its memory is reused.
 
 class Environment {
+   struct Binding {
+      Value value;
+      bool defined = false;
+   };
+
    Environment* parent;
-   std::unordered_map<std::string, Value> vars;
+   std::vector<Binding> slots;
+   const Scope* scope;
+   SymbolMap<Value> vars;
+   std::uint64_t revision;
+
+   Value* find(Symbol identifier);
 
 public:
-   Environment(Environment* parent);
-   Environment();
+   Environment(Environment* parent, const Scope* scope = nullptr);
+   Environment(const Scope* scope = nullptr);
+
+   void reset(Environment* parent, const Scope* scope);
+   std::size_t memory() const;
+
+   Environment* ancestor(int depth);
+   bool defines(int slot) const { return slots[slot].defined; }
+   std::uint64_t version() const { return revision; }
 
-   void set(const std::string& identifier, Value value);
-   Value get(const std::string& identifier);
-   Environment& resolve(const std::string& identifier);
+   void set(Symbol identifier, Value value);
+   void set_slot(int slot, Value value);
+   Value get(Symbol identifier);
+   Value get(int depth, int slot, Symbol identifier);
 };
 
+// Builtins
+
+const std::vector<std::pair<Symbol, Value>>& builtins();
+
 #endif
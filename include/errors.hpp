@@ -0,0 +1,43 @@
+#ifndef ERRORS_HPP
+#define ERRORS_HPP
+
+// Includes
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Errors
+//
+// Runtime and compile errors unwind to whoever started the program instead of ending the process.
+// The command line driver prints the message and exits with the status, an embedding hands both
+// back to its caller. The 'Exit' command unwinds the same way with status 0 and no message.
+
+namespace error {
+   struct Exit {
+      int status;
+      std::string message;
+   };
+
+   [[noreturn]] void fail(const std::string& message);
+   [[noreturn]] void exit();
+
+   // The parser, the passes over the tree and the tree walker recurse on the native stack, so they
+   // call 'check_stack', which fails with 'message' once less than 'stack_reserve' of the running
+   // thread's stack is left. 'stack_floor' starts out above every stack, so the first check on a
+   // thread takes the slow path, which finds the thread's stack.
+
+   constexpr std::size_t stack_reserve = 256 << 10;
+   extern constinit thread_local std::uintptr_t stack_floor;
+
+   void check_stack_slow(const char* message);
+
+   inline void check_stack(const char* message) {
+      char marker;
+      if (std::uintptr_t(&marker) < stack_floor) [[unlikely]] {
+         check_stack_slow(message);
+      }
+   }
+}
+
+#endif
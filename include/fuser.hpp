@@ -0,0 +1,30 @@
+#ifndef FUSER_HPP
+#define FUSER_HPP
+
+// Includes
+
+#include "ast.hpp"
+
+// Fuser
+//
+// Peephole pass run after the resolver. It replaces frequent pairs of adjacent statements with a
+// single fused command so that they are evaluated in one dispatch. Only commands without a repeat
+// count take part, and pushed literals have to fit in 32 bits so the VM can keep them inline.
+
+class Fuser {
+   Ast* ast = nullptr;
+
+   // Fuse functions
+
+   void fuse_stmt(NodeId id);
+   void fuse_block(std::uint32_t list);
+
+   // Helper functions
+
+   NodeId match(NodeId first, NodeId second);
+
+public:
+   void fuse(Ast& program);
+};
+
+#endif
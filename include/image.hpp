@@ -0,0 +1,32 @@
+#ifndef IMAGE_HPP
+#define IMAGE_HPP
+
+// Includes
+
+#include "ast.hpp"
+#include <string>
+#include <utility>
+#include <vector>
+
+// Program image
+//
+// A '.meic' file holds a parsed program together with every module it imports through a string
+// literal, so that running it needs no lexing or parsing. The format is versioned and position
+// independent: every module is stored as its node arena, which refers to lists, symbols and
+// strings by index only, and is copied back as is when the image is loaded. Symbols are stored by
+// name and interned again on load. Programs are stored before resolution and fusion, both passes
+// run again after loading.
+
+namespace image {
+   constexpr char magic[4] {'M', 'E', 'I', 'C'};
+   constexpr std::uint32_t version = 2;
+
+   using Imports = std::vector<std::pair<std::string, std::shared_ptr<Ast>>>;
+
+   bool is_image(const std::string& path);
+   Imports collect_imports(const Ast& program);
+   void write(const std::string& path, const Ast& program, const Imports& imports);
+   std::shared_ptr<Ast> load(const std::string& path, Imports& imports);
+}
+
+#endif
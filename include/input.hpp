@@ -0,0 +1,24 @@
+#ifndef INPUT_HPP
+#define INPUT_HPP
+
+// Includes
+
+#include <string>
+
+// Input
+//
+// Standard input is read in large chunks with read(2) into a single buffer shared by all the
+// input commands. Single key reads switch the terminal to non canonical mode once and leave it
+// there until a number or a line is read, the original mode is restored at exit. 'provide' makes
+// the commands on the calling thread read from a string instead, up to its end, which reads as end
+// of input.
+
+namespace input {
+   void provide(std::string text);
+
+   int read_number();
+   bool read_line(std::string& line);
+   int read_key();
+}
+
+#endif
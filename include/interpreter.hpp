@@ -4,41 +4,129 @@
 // Includes
 
 #include "environment.hpp"
-#include <stack>
+#include "jit.hpp"
+#include "modules.hpp"
+#include "profiler.hpp"
+#include <unordered_map>
+
+// Completion
+//
+// Every evaluation function returns its value together with how it completed. 'Break' and
+// 'Continue' complete abruptly, and an abrupt completion is handed up through the enclosing
+// expressions, blocks and calls until a loop consumes it.
+
+enum class Completion : std::uint8_t {
+   normal, break_loop, continue_loop
+};
+
+struct Result {
+   Value value;
+   Completion completion = Completion::normal;
+
+   Result() = default;
+   Result(Value value, Completion completion = Completion::normal)
+      : value(std::move(value)), completion(completion) {}
+
+   bool abrupt() const {
+      return completion != Completion::normal;
+   }
+};
 
 // Interpreter
 
 class Interpreter {
-   std::stack<int> loop_stack, fn_stack, return_stack;
-   int fn_counter = 0;
-   bool should_break = false, should_continue = false;
+   struct TailCall {
+      Value func;
+      bool pending = false;
+   };
+
+   // Inline cache of a call site: the function last called through it together with the
+   // environment and revision its binding was read from
+
+   struct CallSite {
+      const Environment* owner = nullptr;
+      std::uint64_t version = 0;
+      Value fn;
+   };
+
+   // Iterations a 'While' loop has run in the walker, and its compiled code once it got hot
+
+   struct HotLoop {
+      unsigned long iterations = 0;
+      bool tried = false;
+      std::unique_ptr<jit::Loop> code;
+   };
+
+   // The hot loops of one program by node, 'owner' tells a program that was freed from a later
+   // one allocated at the same address, whose loops must not run the old code
+
+   struct HotLoops {
+      std::weak_ptr<const Ast> owner;
+      std::unordered_map<NodeId, HotLoop> loops;
+   };
+
+   long loops = 0;
+   bool jit;
+   const Ast* ast = nullptr;
+   TailCall tail;
+   std::vector<Value> arguments;
+   std::unordered_map<const Ast*, std::vector<CallSite>> call_sites;
+   std::vector<CallSite>* sites = nullptr;
+   std::unordered_map<const Ast*, HotLoops> hot_loops;
+   HotLoops* hot = nullptr;
+   Importer importer;
+   Profiler* profiler = nullptr;
+
+   const Node& at(NodeId id) const {
+      return ast->nodes[id];
+   }
+
+   void enter(const Ast* program);
+   Result run(const Ast& program, Environment& env);
+   Result invoke(Value func, std::size_t base, bool checked);
+   Result evaluate_block(Environment& env, const Node& block);
+   Result resume_loop(Environment& env, const Node& body, std::uint32_t from);
 
    // Statement evaluation functions
 
-   Value evaluate_stmt(Environment& env, Stmt stmt);
-   Value evaluate_var_decl(Environment& env, Stmt stmt);
-   Value evaluate_fn_decl(Environment& env, Stmt stmt);
-   Value evaluate_while_loop(Environment& env, Stmt stmt);
-   Value evaluate_break(Environment& env, Stmt stmt);
-   Value evaluate_continue(Environment& env, Stmt stmt);
-   Value evaluate_push(Environment& env, Stmt stmt);
-   Value evaluate_type(Environment& env, Stmt stmt);
-   Value evaluate_pull(Environment& env, Stmt stmt);
-   Value evaluate_import(Environment& env, Stmt stmt);
+   Result evaluate_stmt(Environment& env, const Node& node);
+   Result evaluate_profiled(Environment& env, const Node& node);
+   Result dispatch_stmt(Environment& env, const Node& node);
+   Result evaluate_var_decl(Environment& env, const Node& node);
+   Result evaluate_fn_decl(Environment& env, const Node& node);
+   Result evaluate_while_loop(Environment& env, const Node& node);
+   Result evaluate_break(Environment& env, const Node& node);
+   Result evaluate_continue(Environment& env, const Node& node);
+   Result evaluate_push(Environment& env, const Node& node);
+   Result evaluate_type(Environment& env, const Node& node);
+   Result evaluate_pull(Environment& env, const Node& node);
+   Result evaluate_import(Environment& env, const Node& node);
 
    // Expression evaluation functions
 
-   Value evaluate_expr(Environment& env, Stmt stmt);
-   Value evaluate_ternary_expr(Environment& env, Stmt stmt);
-   Value evaluate_call_expr(Environment& env, Stmt stmt);
-   Value evaluate_command(Environment& env, Stmt stmt);
-   Value evaluate_primary_expr(Environment& env, Stmt stmt);
+   Result evaluate_expr(Environment& env, const Node& node);
+   Result evaluate_ternary_expr(Environment& env, const Node& node);
+   Result evaluate_call_expr(Environment& env, const Node& node);
+   Result evaluate_command(Environment& env, const Node& node);
+   Result evaluate_fused_command(Environment& env, const Node& node);
+   Result evaluate_primary_expr(Environment& env, const Node& node);
 
 public:
+   Interpreter(bool fuse = true, bool import_once = false, bool jit = false);
+
    // Evaluation functions
 
-   Value evaluate(Program& program, Environment& env);
+   Value evaluate(const Ast& program, Environment& env);
    Value call(Environment& env, Value func, std::vector<Value>& args);
+
+   // Names the file the program was read from, so that an import of it is caught as a cycle
+
+   void source(const std::string& path);
+
+   // Attaches a profiler, or detaches it with null. Loops are not compiled while one is attached,
+   // so that every statement is seen.
+
+   void profile(Profiler* profiler);
 };
 
 #endif
@@ -0,0 +1,61 @@
+#ifndef JIT_HPP
+#define JIT_HPP
+
+// Includes
+
+#include "ast.hpp"
+#include <memory>
+
+// JIT
+//
+// Compiles a 'While' loop whose body is made of stack commands only into x86-64 code that works
+// on the operand stack buffer directly. The compiled loop pops and tests the condition itself and
+// checks once per iteration that the stack is deep enough and has room for the whole body. When
+// a check fails, a divisor is 0 or a register lies outside the dense range, it hands the
+// iteration back to the tree walker at the statement that could not run. The stack is then
+// exactly as the walker would have left it up to that statement.
+//
+// Loops containing anything else, such as I/O, calls, names or repeat counts, and every loop on
+// other targets are not compiled.
+
+namespace jit {
+   constexpr unsigned threshold = 64;
+
+   // Shared with the generated code, which reads and writes the fields by offset
+
+   struct Frame {
+      long* data;
+      long* top;
+      long* end;
+      long* registers;
+      unsigned long register_count;
+      long result;
+      long ran;
+   };
+
+   class Loop {
+      void* code = nullptr;
+      std::size_t size = 0;
+
+      Loop(void* code, std::size_t size);
+
+   public:
+      Loop(const Loop&) = delete;
+      Loop& operator=(const Loop&) = delete;
+      ~Loop();
+
+      // Returns null when the loop cannot be compiled
+
+      static std::unique_ptr<Loop> compile(const Ast& ast, const Node& loop);
+
+      // Returns 0 once the loop has ended, otherwise 'k + 1' when the condition has been popped
+      // and the body has to go on in the walker from its statement 'k'. 'ran' is set when at least
+      // one iteration completed, 'result' then holds the value of the body's last statement.
+
+      int run(Frame& frame) const {
+         return reinterpret_cast<int (*)(Frame*)>(code)(&frame);
+      }
+   };
+}
+
+#endif
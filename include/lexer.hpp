@@ -7,16 +7,23 @@
 #include <vector>
 
 // Lexer
+//
+// Splits the source into tokens that point back into it, so the source has to outlive the
+// tokens and anything parsed from them.
 
 class Lexer {
-   const std::string& code;
+   std::string_view code;
    std::vector<Token> tokens;
-   
-   char as_escape(char ch);
+   std::size_t line = 1, line_start = 0;
+
+   void add(Type type, std::size_t start, std::size_t end, Symbol symbol = keyword::none);
+   void newlines(std::size_t start, std::size_t end);
 
 public: 
-   Lexer(const std::string& code);
+   Lexer(std::string_view code);
    std::vector<Token>& lex();
+
+   static std::string unescape(std::string_view raw);
 };
 
 #endif
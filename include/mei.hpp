@@ -0,0 +1,116 @@
+#ifndef MEI_HPP
+#define MEI_HPP
+
+// Includes
+
+#include "ast.hpp"
+#include "output.hpp"
+#include "stack.hpp"
+#include "stats.hpp"
+#include "vm.hpp"
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Embedding
+//
+// Runs MEI programs inside a host process. A program is parsed, resolved and fused once and can
+// then be run any number of times by any instance. Errors, including compile errors, come back as
+// a status instead of ending the process, and output is collected instead of written to stdout.
+//
+// Every instance has its own operand stack, registers and output, so instances on different
+// threads run side by side. A single instance is used by one thread at a time.
+
+namespace mei {
+   enum class Engine {
+      tree, vm
+   };
+
+   struct Options {
+      Engine engine = Engine::tree;
+      bool fuse = true;
+      bool import_once = false;
+      bool jit = false;
+      bool stats = false;
+      unsigned long registers = reg::default_size;
+      std::size_t recursion_memory = default_recursion_memory;
+   };
+
+   // 'status' is what the command line driver would exit with, 'Exit' gives 0 like a normal end
+
+   struct Status {
+      int status = 0;
+      std::string error;
+
+      bool ok() const {
+         return status == 0;
+      }
+   };
+
+   using Program = std::shared_ptr<const Ast>;
+
+   Status parse(std::string_view source, Program& program, const Options& options = {});
+
+   // Reads a whole script or input file, returns false when it cannot be opened
+
+   bool read_file(const std::string& path, std::string& text);
+
+   // Parsed programs by source text, shared between threads. A source is parsed by the first
+   // thread that asks for it while the others wait. Once 'capacity' sources are held the cache
+   // starts over, programs that are still running stay alive through their own references.
+
+   class Cache {
+      struct Entry {
+         std::once_flag once;
+         Program program;
+         Status status;
+      };
+
+      std::mutex mutex;
+      std::unordered_map<std::string, std::shared_ptr<Entry>> entries;
+      Options options;
+      std::size_t capacity;
+
+   public:
+      Cache(Options options = {}, std::size_t capacity = 4096);
+
+      Status get(const std::string& source, Program& program);
+   };
+
+   class Instance {
+      Options options;
+      State state;
+      output::Buffer out;
+      stats::Counters gathered;
+
+   public:
+      Instance(Options options = {});
+
+      // Runs a program with 'input' as everything the program reads, the stack and registers are
+      // kept from earlier runs until 'reset'. 'path' names the file the program was read from, if
+      // any, so that an import of it is caught as a cycle.
+
+      Status run(std::string_view source, std::string input = {});
+      Status run(const Program& program, std::string input = {}, const std::string& path = {});
+
+      // Hands output to 'sink' as it is produced instead of collecting it for 'output', an empty
+      // sink goes back to collecting
+
+      void stream(std::function<void(std::string_view)> sink);
+
+      std::vector<long> stack() const;
+      std::string output();
+      void reset();
+
+      // Counters of every run since the last 'reset', including parsing the sources passed as
+      // text. They are only gathered with 'stats' set in the options.
+
+      const stats::Counters& counters() const;
+   };
+}
+
+#endif
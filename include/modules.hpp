@@ -0,0 +1,68 @@
+#ifndef MODULES_HPP
+#define MODULES_HPP
+
+// Includes
+
+#include "ast.hpp"
+#include "image.hpp"
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+// Module
+//
+// Imported code is lexed, parsed, resolved and fused once per process and shared from then on.
+// Files are keyed by their canonical path and reloaded when their modification time or size
+// changes, code that is imported inline is keyed by its text. The cache holds a bounded number of
+// modules and starts over when it is full. Modules embedded in a program image take precedence
+// over both, but only for imports made by that image's program and its embedded modules, where
+// they are found by the import argument they were stored under.
+
+struct Module {
+   std::string key;
+   std::shared_ptr<Ast> program;
+   std::filesystem::file_time_type mtime;
+   std::uintmax_t size = 0;
+};
+
+// The embedded modules of one loaded image, as parsed. Every load of an image gets a bundle with a
+// key of its own, so images never see each other's modules.
+
+struct Bundle {
+   std::string key;
+   std::unordered_map<std::string, std::shared_ptr<const Ast>> modules;
+};
+
+namespace modules {
+   std::shared_ptr<const Bundle> bundle(const std::string& path, image::Imports imports);
+   std::shared_ptr<Module> load(const std::string& code, bool fuse, const std::shared_ptr<const Bundle>& bundle = nullptr);
+
+   // The key the file at 'path' is cached under
+
+   std::string key(const std::string& path, bool fuse);
+}
+
+// Importer
+//
+// Import state of a single interpreter: the modules currently being imported, to catch cycles,
+// and with 'once' set the modules already imported, which are skipped from then on.
+
+class Importer {
+   std::vector<std::string> active;
+   std::unordered_set<std::string> imported;
+   bool fuse, once;
+
+public:
+   Importer(bool fuse, bool once);
+
+   std::shared_ptr<Module> enter(const std::string& code, const std::shared_ptr<const Bundle>& bundle);
+   void leave();
+
+   // Marks the file the program itself was read from as being imported, so that a cycle back to
+   // it is caught before it runs a second time
+
+   void root(const std::string& path);
+};
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef OUTPUT_HPP
+#define OUTPUT_HPP
+
+// Includes
+
+#include <cstring>
+#include <functional>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+// Output
+//
+// Everything printed by ',' and '.' goes into one large buffer that is written out with write(2).
+// The buffer is also installed as the stream buffer of std::cout, so messages written to std::cerr
+// (which is tied to std::cout) still appear after the output that came before them.
+//
+// The commands write to 'target', which is that buffer unless the calling thread points it at one
+// of its own. An embedding does so with a buffer under the 'never' policy and takes the collected
+// output out with 'take', or hands it to a 'sink' in place of stdout to stream it elsewhere.
+
+namespace output {
+   enum class Flush {
+      line, full, never
+   };
+
+   class Buffer : public std::streambuf {
+      std::vector<char> storage;
+
+      void make_room(std::size_t size);
+      void emit(const char* data, std::size_t size);
+
+   protected:
+      int_type overflow(int_type ch) override;
+      std::streamsize xsputn(const char* data, std::streamsize size) override;
+      int sync() override;
+
+   public:
+      Flush policy = Flush::full;
+      std::function<void(const char* data, std::size_t size)> sink;
+
+      Buffer();
+      void write_out();
+      std::string take();
+   };
+
+   extern Buffer buffer;
+   extern constinit thread_local Buffer* target;
+
+   void init(Flush policy);
+   void flush();
+   void flush_for_input();
+
+   inline void put(char ch) {
+      target->sputc(ch);
+      if (ch == '\n' && target->policy == Flush::line) {
+         flush();
+      }
+   }
+
+   inline void write(const char* data, std::size_t size) {
+      target->sputn(data, size);
+      if (target->policy == Flush::line && std::memchr(data, '\n', size)) {
+         flush();
+      }
+   }
+}
+
+#endif
@@ -9,25 +9,26 @@
 
 class Parser {
    std::vector<Token>& tokens;
-   Program program;
+   std::string_view code;
+   std::shared_ptr<Ast> ast;
    size_t index = 0;
 
    // Parse functions
 
-   Stmt parse_stmt();
-   Stmt parse_var_decl();
-   Stmt parse_fn_decl();
-   Stmt parse_while_loop();
-   Stmt parse_break_stmt();
-   Stmt parse_continue_stmt();
-   Stmt parse_push_stmt();
-   Stmt parse_type_stmt();
-   Stmt parse_import();
-
-   Stmt parse_expr();
-   Stmt parse_ternary_expr();
-   Stmt parse_call_expr();
-   Stmt parse_primary_expr();
+   NodeId parse_stmt();
+   NodeId parse_var_decl();
+   NodeId parse_fn_decl();
+   NodeId parse_while_loop();
+   NodeId parse_break_stmt();
+   NodeId parse_continue_stmt();
+   NodeId parse_push_stmt();
+   NodeId parse_type_stmt();
+   NodeId parse_import();
+
+   NodeId parse_expr();
+   NodeId parse_ternary_expr();
+   NodeId parse_call_expr();
+   NodeId parse_primary_expr();
 
    // Helper functions
 
@@ -36,8 +37,8 @@ class Parser {
    Token& current();
 
 public:
-   Parser(std::vector<Token>& tokens);
-   Program& parse();
+   Parser(std::vector<Token>& tokens, std::string_view code);
+   std::shared_ptr<Ast> parse();
 };
 
 #endif
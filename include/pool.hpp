@@ -0,0 +1,20 @@
+#ifndef POOL_HPP
+#define POOL_HPP
+
+// Includes
+
+#include <cstddef>
+#include <functional>
+
+// Pool
+//
+// Runs jobs 0 up to 'count' on 'threads' worker threads and returns once all of them are done.
+// The jobs are dealt out in contiguous runs to one queue per worker. A worker takes jobs from the
+// back of its own queue and, once that is empty, steals from the front of the others, so a few
+// long jobs do not leave the remaining threads idle.
+
+namespace pool {
+   void run(std::size_t count, unsigned threads, const std::function<void(unsigned worker, std::size_t job)>& work);
+}
+
+#endif
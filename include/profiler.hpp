@@ -0,0 +1,169 @@
+#ifndef PROFILER_HPP
+#define PROFILER_HPP
+
+// Includes
+
+#include "ast.hpp"
+#include "symbols.hpp"
+#include "tokens.hpp"
+#include <csignal>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Profiler
+//
+// Records where the tree walker spends its time. In 'trace' mode every statement is counted and
+// timed, exclusive time being the part not spent in nested statements. In 'sample' mode a SIGPROF
+// timer only marks that a sample is due, and the walker takes it at the next statement by walking
+// its own function stack, so the overhead is one flag test per statement. Both modes count the
+// calls of every function and keep a call tree, which is written as folded stacks next to the
+// report. One profiler can be attached to one interpreter at a time.
+
+class Profiler {
+public:
+   enum class Mode {
+      trace, sample
+   };
+
+private:
+   struct Stats {
+      const Ast* ast;
+      NodeId id;
+      Symbol function;
+      std::uint64_t count = 0;
+      std::int64_t inclusive = 0, exclusive = 0;
+      unsigned active = 0;
+   };
+
+   struct Function {
+      std::uint32_t index;
+      Symbol name;
+      std::uint64_t calls = 0;
+   };
+
+   // A node of the call tree, 'weight' is exclusive nanoseconds when tracing and samples otherwise
+
+   struct Frame {
+      std::uint32_t parent;
+      const Node* body;
+      Symbol name;
+      std::int64_t weight = 0;
+   };
+
+   struct Open {
+      Stats* stats;
+      std::int64_t start;
+      std::int64_t children = 0;
+   };
+
+   static volatile std::sig_atomic_t pending;
+   static void on_timer(int signal);
+
+   Mode mode;
+   unsigned rate;
+   std::int64_t started;
+   std::unordered_map<const Node*, Stats> nodes;
+   std::unordered_map<const Node*, Function> functions;
+   std::unordered_map<std::uint64_t, std::uint32_t> children;
+   std::vector<Frame> frames;
+   std::vector<Open> open;
+   std::uint32_t current = 0;
+   std::uint64_t samples = 0;
+   std::uint64_t commands[std::size_t(Type::land) + 1] = {};
+   std::uint64_t fusions[std::size_t(Fusion::push_greater) + 1] = {};
+
+   Stats& stats(const Ast& ast, const Node& node);
+   void sample(const Ast& ast, const Node& node);
+
+public:
+   static constexpr unsigned default_rate = 1000;
+
+   Profiler(Mode mode, unsigned rate = default_rate);
+   Profiler(const Profiler&) = delete;
+   Profiler& operator=(const Profiler&) = delete;
+   ~Profiler();
+
+   bool tracing() const {
+      return mode == Mode::trace;
+   }
+
+   // Statement hooks, 'begin' and 'end' bracket a statement when tracing, 'poll' takes a due
+   // sample otherwise
+
+   void begin(const Ast& ast, const Node& node);
+   void end();
+
+   void poll(const Ast& ast, const Node& node) {
+      if (pending) [[unlikely]] {
+         pending = 0;
+         sample(ast, node);
+      }
+   }
+
+   // Command hooks, a repeated command counts every time it runs
+
+   void command(Type op, long times = 1) {
+      if (times > 0) {
+         commands[std::size_t(op)] += times;
+      }
+   }
+
+   void command(Fusion fusion) {
+      ++fusions[std::size_t(fusion)];
+   }
+
+   // Function hooks, a tail call leaves the caller before entering the callee
+
+   void enter(const Node& body, Symbol name);
+   void leave();
+
+   // Guards that pair the hooks, so that a statement or call left by an error or by '@' is still
+   // closed and credited. A 'Call' without a profiler does nothing.
+
+   class Statement {
+      Profiler& profiler;
+
+   public:
+      Statement(Profiler& profiler, const Ast& ast, const Node& node)
+         : profiler(profiler) {
+         profiler.begin(ast, node);
+      }
+
+      Statement(const Statement&) = delete;
+      Statement& operator=(const Statement&) = delete;
+
+      ~Statement() {
+         profiler.end();
+      }
+   };
+
+   class Call {
+      Profiler* profiler;
+
+   public:
+      Call(Profiler* profiler, const Node& body, Symbol name)
+         : profiler(profiler) {
+         if (profiler) [[unlikely]] {
+            profiler->enter(body, name);
+         }
+      }
+
+      Call(const Call&) = delete;
+      Call& operator=(const Call&) = delete;
+
+      ~Call() {
+         if (profiler) [[unlikely]] {
+            profiler->leave();
+         }
+      }
+   };
+
+   // Writes the sorted report to 'path' and the folded stacks to 'path.folded', returns false when
+   // either file could not be written
+
+   bool write(const std::string& path) const;
+};
+
+#endif
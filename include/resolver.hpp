@@ -0,0 +1,46 @@
+#ifndef RESOLVER_HPP
+#define RESOLVER_HPP
+
+// Includes
+
+#include "environment.hpp"
+
+// Resolver
+//
+// Runs after the parser and assigns every identifier a (depth, slot) pair in the environment
+// chain it will be evaluated in. A scope that contains an 'Import' may gain names at runtime, so
+// any lookup passing through it is left to the dynamic, name based path.
+//
+// The resolver also marks calls in tail position of function bodies that cannot capture their
+// frame, that is bodies without 'Fn' or 'Import', so that the frame can be reused for the callee.
+
+class Resolver {
+   struct Frame {
+      std::shared_ptr<Scope> scope;
+      bool open = false;
+      bool function = false, captured = false;
+   };
+
+   Ast* ast = nullptr;
+   std::vector<Frame> frames;
+
+   // Resolve functions
+
+   void resolve_stmt(NodeId id);
+   void resolve_fn_decl(NodeId id);
+   void resolve_block(NodeId id);
+   void resolve_identifier(Node& ident);
+   void mark_tail(NodeId id);
+
+   // Helper functions
+
+   void declare(NodeId id);
+   void declare_name(NodeId identifier);
+   void capture();
+
+public:
+   void resolve(Ast& program);
+   void resolve_import(Ast& program);
+};
+
+#endif
@@ -0,0 +1,26 @@
+#ifndef SERVE_HPP
+#define SERVE_HPP
+
+// Includes
+
+#include "mei.hpp"
+#include <string>
+
+// Server
+//
+// Listens on a Unix domain socket and runs one request per connection on a pool of warm
+// interpreter instances that share a cache of parsed programs. Integers are in host byte order.
+//
+//   Request    u8 kind ('p' for a script path, 's' for source), u32 size, script,
+//              u32 size, bytes the script reads as its input
+//   Response   any number of u8 'o', u32 size, output as it is produced,
+//              then u8 'x', i32 exit status, u32 size, error message
+//
+// A worker waits at most 10 seconds for a request to arrive in full before it closes the connection.
+// Never returns unless the socket cannot be set up.
+
+namespace serve {
+   [[noreturn]] void run(const std::string& path, const mei::Options& options, unsigned threads);
+}
+
+#endif
@@ -1,21 +1,166 @@
 #ifndef STACK_HPP
 #define STACK_HPP
 
+// Includes
+
+#include <unordered_map>
+#include <vector>
+
 // Stack
+//
+// The operand stack is a single contiguous buffer with a top pointer. The checked functions keep
+// the old semantics of reading 0 from an empty stack, the unchecked ones are for commands that
+// have already verified the depth once up front. The buffer is a view into the state of the
+// interpreter running on the calling thread, see 'State' below.
 
 namespace stack {
-   void push(long value);
-   long top();
-   long pop();
-   unsigned long size();
-   bool empty();
+   // 'end' is where the checked pushes stop and call 'grow'. It is the end of the allocation unless
+   // the stack is watched, in which case it is the highest the stack has been and 'grow' moves it up
+   // within the allocation, so tracking the high-water mark costs nothing on pushes below it.
+
+   struct Buffer {
+      long* data;
+      long* top;
+      long* end;
+      long* capacity;
+   };
+
+   extern constinit thread_local Buffer buffer;
+   void grow(unsigned long count = 1);
+   void watch(bool enable);
+   unsigned long high_water();
+
+   // Checked access
+
+   inline void push(long value) {
+      if (buffer.top == buffer.end) [[unlikely]] {
+         grow();
+      }
+      *buffer.top++ = value;
+   }
+
+   inline long top() {
+      return (buffer.top == buffer.data ? 0 : buffer.top[-1]);
+   }
+
+   inline long pop() {
+      return (buffer.top == buffer.data ? 0 : *--buffer.top);
+   }
+
+   inline unsigned long size() {
+      return buffer.top - buffer.data;
+   }
+
+   inline bool empty() {
+      return buffer.top == buffer.data;
+   }
+
+   inline void reserve(unsigned long count) {
+      if (static_cast<unsigned long>(buffer.end - buffer.top) < count) {
+         grow(count);
+      }
+   }
+
+   inline void push_n(long value, unsigned long count) {
+      reserve(count);
+      for (unsigned long i = 0; i < count; ++i) {
+         buffer.top[i] = value;
+      }
+      buffer.top += count;
+   }
+
+   inline void push_reversed(const char* data, unsigned long count) {
+      reserve(count);
+      for (unsigned long i = 0; i < count; ++i) {
+         buffer.top[i] = data[count - 1 - i];
+      }
+      buffer.top += count;
+   }
+
+   // Unchecked access, 'n' counts down from the top starting at 0
+
+   inline long peek(unsigned long n) {
+      return buffer.top[-1 - long(n)];
+   }
+
+   inline void pop2(long& a, long& b) {
+      a = buffer.top[-1];
+      b = buffer.top[-2];
+      buffer.top -= 2;
+   }
+
+   inline void replace_top(long value) {
+      buffer.top[-1] = value;
+   }
+
+   inline void drop(unsigned long n) {
+      buffer.top -= n;
+   }
 }
 
 // Registers
+//
+// Registers 0 up to the dense size live in a flat array, every other index falls back to a hash
+// map. Unset registers read as 0. Like the stack, 'file' is a view into the running state.
 
 namespace reg {
-   void set(long index, long value);
-   long get(long index);
+   constexpr unsigned long default_size = 1024;
+
+   struct File {
+      long* dense;
+      unsigned long size;
+   };
+
+   extern constinit thread_local File file;
+   void set_sparse(long index, long value);
+   long get_sparse(long index);
+   std::size_t sparse_count();
+
+   inline void set(long index, long value) {
+      if (static_cast<unsigned long>(index) < file.size) [[likely]] {
+         file.dense[index] = value;
+      } else {
+         set_sparse(index, value);
+      }
+   }
+
+   inline long get(long index) {
+      if (static_cast<unsigned long>(index) < file.size) [[likely]] {
+         return file.dense[index];
+      }
+      return get_sparse(index);
+   }
 }
 
+// State
+//
+// The operand stack and the registers of one interpreter. 'enter' points the thread local views
+// of the calling thread at them until 'leave', which restores the state entered before, so
+// interpreters on different threads never share either. A program only runs with a state entered.
+
+class State {
+   stack::Buffer buffer {nullptr, nullptr, nullptr, nullptr};
+   std::vector<long> dense;
+   std::unordered_map<long, long> sparse;
+   State* outer = nullptr;
+
+   void bind();
+
+   friend void reg::set_sparse(long index, long value);
+   friend long reg::get_sparse(long index);
+   friend std::size_t reg::sparse_count();
+
+public:
+   State(unsigned long registers = reg::default_size);
+   State(const State&) = delete;
+   State& operator=(const State&) = delete;
+   ~State();
+
+   void enter();
+   void leave();
+   void clear();
+
+   std::vector<long> stack() const;
+};
+
 #endif
@@ -0,0 +1,62 @@
+#ifndef STATS_HPP
+#define STATS_HPP
+
+// Includes
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+
+// Stats
+//
+// Counters gathered in the hot paths of the front end, the environments and the stack. They are
+// only collected while 'counters' points at a set of them, which like the stack is per thread, so
+// a disabled counter costs one thread local load and a branch that is never taken.
+
+namespace stats {
+   constexpr int depths = 8;
+
+   struct Counters {
+      std::uint64_t allocations[5] = {};
+      std::uint64_t environments = 0, reuses = 0;
+      std::uint64_t lookups = 0, lookup_steps = 0, longest_lookup = 0;
+      std::uint64_t slot_reads[depths] = {};
+      std::uint64_t imports = 0;
+      unsigned long stack_high_water = 0;
+      std::size_t sparse_registers = 0;
+      std::int64_t lex_time = 0, parse_time = 0;
+
+      // 'allocations' is indexed by ValueType, 'slot_reads' by depth with the last entry counting
+      // every deeper read too, the times are in nanoseconds
+
+      void report(std::ostream& out) const;
+   };
+
+   extern constinit thread_local Counters* counters;
+
+   // Adds the time until it goes out of scope to one of the time fields
+
+   class Timer {
+      Counters* target;
+      std::int64_t Counters::* field;
+      std::chrono::steady_clock::time_point start;
+
+   public:
+      explicit Timer(std::int64_t Counters::* field)
+         : target(counters), field(field), start(target ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point{}) {}
+
+      ~Timer() {
+         if (target) {
+            target->*field += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+         }
+      }
+   };
+
+   // Starts and stops collecting into 'target' on the calling thread. Collection keeps the stack
+   // tracking its high-water mark, which is stored when it stops together with the register count.
+
+   void start(Counters& target);
+   void stop();
+}
+
+#endif
@@ -0,0 +1,151 @@
+#ifndef SYMBOLS_HPP
+#define SYMBOLS_HPP
+
+// Includes
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Symbol
+//
+// Identifiers and keywords are interned once per process and passed around as dense integer ids.
+// Id 0 is never handed out, the keywords are interned first so that their ids are fixed.
+
+using Symbol = std::uint32_t;
+
+namespace keyword {
+   enum : Symbol {
+      none,
+      Const, Fn, While, Break, Continue, Import,
+      Push, X, S, Type, Pull,
+      count
+   };
+
+   constexpr std::string_view names[] {
+      "", "Const", "Fn", "While", "Break", "Continue", "Import", "Push", "X", "S", "Type", "Pull"
+   };
+   static_assert(sizeof(names) / sizeof(names[0]) == count);
+
+   // Returns the fixed id of a keyword without touching the symbol table, 'none' otherwise
+
+   constexpr Symbol find(std::string_view name) {
+      if (name.empty()) {
+         return none;
+      }
+
+      Symbol candidate = none;
+      switch (name[0]) {
+      case 'C': candidate = (name.size() == 5 ? Const : Continue); break;
+      case 'F': candidate = Fn; break;
+      case 'W': candidate = While; break;
+      case 'B': candidate = Break; break;
+      case 'I': candidate = Import; break;
+      case 'P': candidate = (name.size() > 2 && name[2] == 'l' ? Pull : Push); break;
+      case 'X': candidate = X; break;
+      case 'S': candidate = S; break;
+      case 'T': candidate = Type; break;
+      default:  return none;
+      }
+      return (names[candidate] == name ? candidate : none);
+   }
+}
+
+namespace symbol {
+   Symbol intern(std::string_view name);
+   const std::string& name(Symbol symbol);
+
+   inline std::uint64_t hash(Symbol symbol) {
+      return symbol * 0x9e3779b97f4a7c15ull;
+   }
+}
+
+// Symbol map
+//
+// Open addressing hash map keyed by symbol with linear probing. Symbols are hashed with a single
+// multiplication, so no string is hashed or compared on lookup.
+
+template<typename T>
+class SymbolMap {
+   struct Entry {
+      Symbol key = keyword::none;
+      T value {};
+   };
+
+   std::vector<Entry> entries;
+   std::size_t count = 0;
+   int shift = 64;
+
+   std::size_t index(Symbol key) const {
+      return symbol::hash(key) >> shift;
+   }
+
+   void grow() {
+      auto old = std::move(entries);
+      entries = std::vector<Entry>(old.empty() ? 8 : old.size() * 2);
+      shift = (old.empty() ? 61 : shift - 1);
+
+      for (auto& entry : old) {
+         if (entry.key != keyword::none) {
+            insert(entry.key) = std::move(entry.value);
+         }
+      }
+   }
+
+   T& insert(Symbol key) {
+      auto mask = entries.size() - 1;
+      for (auto i = index(key);; i = (i + 1) & mask) {
+         if (entries[i].key == keyword::none) {
+            entries[i].key = key;
+            ++count;
+            return entries[i].value;
+         }
+
+         if (entries[i].key == key) {
+            return entries[i].value;
+         }
+      }
+   }
+
+public:
+   T* find(Symbol key) {
+      return const_cast<T*>(static_cast<const SymbolMap&>(*this).find(key));
+   }
+
+   const T* find(Symbol key) const {
+      if (entries.empty()) {
+         return nullptr;
+      }
+
+      auto mask = entries.size() - 1;
+      for (auto i = index(key);; i = (i + 1) & mask) {
+         if (entries[i].key == key) {
+            return &entries[i].value;
+         }
+
+         if (entries[i].key == keyword::none) {
+            return nullptr;
+         }
+      }
+   }
+
+   T& operator[](Symbol key) {
+      if ((count + 1) * 4 > entries.size() * 3) {
+         grow();
+      }
+      return insert(key);
+   }
+
+   std::size_t size() const {
+      return count;
+   }
+
+   void clear() {
+      entries.clear();
+      count = 0;
+      shift = 64;
+   }
+};
+
+#endif
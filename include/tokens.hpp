@@ -3,13 +3,14 @@
 
 // Includes
 
-#include <string>
-#include <unordered_map>
-#include <unordered_set>
+#include "symbols.hpp"
+#include <cstdint>
+#include <string_view>
+#include <utility>
 
 // Tokens
 
-enum class Type {
+enum class Type : std::uint8_t {
    number, string, identifier, keyword, eof,
    tilde, grave, exclamation, at, hash, dollar, percent, caret, ampersand,
    asterisk, open_paren, close_paren, hyphen, plus, equal, open_brace,
@@ -18,34 +19,125 @@ enum class Type {
    times, size, thn, els, set_reg, get_reg, lor, land
 };
 
+// Token
+//
+// Tokens do not own their text, 'offset' and 'length' locate the lexeme in the source the lexer
+// was given. For strings the lexeme is the raw text between the quotes, escapes included.
+
 struct Token {
    Type type;
-   std::string lexeme;
+   Symbol symbol = keyword::none;
+   std::uint32_t offset = 0, length = 0;
+   std::uint32_t line = 0, column = 0;
+
+   std::string_view lexeme(std::string_view source) const {
+      return source.substr(offset, length);
+   }
 };
 
 // Maps
 
-constexpr int max_op_size = 2;
-static const std::unordered_map<std::string_view, Type> operators {
-   {"`", Type::tilde}, {"~", Type::grave}, {"!", Type::exclamation}, {"@", Type::at},
-   {"#", Type::hash}, {"$", Type::dollar}, {"%", Type::percent}, {"^", Type::caret},
-   {"&", Type::ampersand}, {"*", Type::asterisk}, {"(", Type::open_paren},
-   {")", Type::close_paren}, {"-", Type::hyphen}, {"+", Type::plus}, {"=", Type::equal},
-   {"{", Type::open_brace}, {"}", Type::close_brace}, {"[", Type::open_bracket},
-   {"]", Type::close_bracket}, {"|", Type::pipe}, {"\\", Type::backslash},
-   {":", Type::colon}, {";", Type::semicolon}, {"'", Type::apostrophe},
-   {",", Type::comma}, {"<", Type::less}, {">", Type::greater}, {".", Type::period},
-   {"/", Type::slash}, {"?", Type::question}, {"=>", Type::set_reg}, {"<=", Type::get_reg},
-   {"||", Type::lor}, {"&&", Type::land}
-};
+// Returns the operator starting at 'code' with at most 'size' characters available, preferring
+// the two character operators, and its length, which is 0 for an unknown character
 
-static const std::unordered_set<std::string_view> keywords {
-   "Const", "Fn", "While", "Break", "Continue", "Import",
-};
+constexpr std::pair<Type, int> find_operator(const char* code, std::size_t size) {
+   char next = (size > 1 ? code[1] : '\0');
+
+   switch (code[0]) {
+   case '`':  return {Type::tilde, 1};
+   case '~':  return {Type::grave, 1};
+   case '!':  return {Type::exclamation, 1};
+   case '@':  return {Type::at, 1};
+   case '#':  return {Type::hash, 1};
+   case '$':  return {Type::dollar, 1};
+   case '%':  return {Type::percent, 1};
+   case '^':  return {Type::caret, 1};
+   case '&':  return (next == '&' ? std::pair{Type::land, 2} : std::pair{Type::ampersand, 1});
+   case '*':  return {Type::asterisk, 1};
+   case '(':  return {Type::open_paren, 1};
+   case ')':  return {Type::close_paren, 1};
+   case '-':  return {Type::hyphen, 1};
+   case '+':  return {Type::plus, 1};
+   case '=':  return (next == '>' ? std::pair{Type::set_reg, 2} : std::pair{Type::equal, 1});
+   case '{':  return {Type::open_brace, 1};
+   case '}':  return {Type::close_brace, 1};
+   case '[':  return {Type::open_bracket, 1};
+   case ']':  return {Type::close_bracket, 1};
+   case '|':  return (next == '|' ? std::pair{Type::lor, 2} : std::pair{Type::pipe, 1});
+   case '\\': return {Type::backslash, 1};
+   case ':':  return {Type::colon, 1};
+   case ';':  return {Type::semicolon, 1};
+   case '\'': return {Type::apostrophe, 1};
+   case ',':  return {Type::comma, 1};
+   case '<':  return (next == '=' ? std::pair{Type::get_reg, 2} : std::pair{Type::less, 1});
+   case '>':  return {Type::greater, 1};
+   case '.':  return {Type::period, 1};
+   case '/':  return {Type::slash, 1};
+   case '?':  return {Type::question, 1};
+   default:   return {Type::eof, 0};
+   }
+}
+
+// Returns how a command operator is written, or an empty string for the other token types
+
+constexpr std::string_view spelling(Type type) {
+   switch (type) {
+   case Type::tilde:       return "`";
+   case Type::grave:       return "~";
+   case Type::exclamation: return "!";
+   case Type::at:          return "@";
+   case Type::hash:        return "#";
+   case Type::dollar:      return "$";
+   case Type::percent:     return "%";
+   case Type::caret:       return "^";
+   case Type::ampersand:   return "&";
+   case Type::asterisk:    return "*";
+   case Type::hyphen:      return "-";
+   case Type::plus:        return "+";
+   case Type::equal:       return "=";
+   case Type::backslash:   return "\\";
+   case Type::colon:       return ":";
+   case Type::semicolon:   return ";";
+   case Type::apostrophe:  return "'";
+   case Type::comma:       return ",";
+   case Type::less:        return "<";
+   case Type::greater:     return ">";
+   case Type::period:      return ".";
+   case Type::slash:       return "/";
+   case Type::question:    return "?";
+   case Type::times:       return "X";
+   case Type::size:        return "S";
+   case Type::set_reg:     return "=>";
+   case Type::get_reg:     return "<=";
+   case Type::lor:         return "||";
+   case Type::land:        return "&&";
+   default:                return "";
+   }
+}
+
+// Returns the character an escape sequence stands for, or '\0' for an unknown escape
+
+constexpr char escape_code(char ch) {
+   switch (ch) {
+   case 'a':  return '\a';
+   case 'b':  return '\b';
+   case 't':  return '\t';
+   case 'n':  return '\n';
+   case 'v':  return '\v';
+   case 'f':  return '\f';
+   case 'r':  return '\r';
+   case 'e':  return '\x1b';
+   case '\\': return '\\';
+   case '\'': return '\'';
+   case '"':  return '"';
+   default:   return '\0';
+   }
+}
+
+// Keyword symbols that lex as command operators, indexed by 'symbol - keyword::Push'
 
-static const std::unordered_map<std::string_view, Type> keyword_ops {
-   {"Push", Type::semicolon}, {"X", Type::times}, {"S", Type::size}, {"Type", Type::question},
-   {"Pull", Type::hash},
+constexpr Type keyword_ops[] {
+   Type::semicolon, Type::times, Type::size, Type::question, Type::hash
 };
 
 #endif
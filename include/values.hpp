@@ -2,6 +2,7 @@
 #define VALUES_HPP
 
 #include "ast.hpp"
+#include "stats.hpp"
 #include <iostream>
 
 // Value
@@ -10,39 +11,116 @@ enum class ValueType {
    number, string, fn, array, null
 };
 
-struct ValueLiteral;
-using Value = std::shared_ptr<ValueLiteral>;
+// Heap object
+//
+// Strings, functions and arrays live on the heap behind an intrusive reference count. Values are
+// owned by a single interpreter, so the count is not atomic.
 
 struct ValueLiteral {
    ValueType type;
+   long refs = 0;
 
    ValueLiteral(ValueType type)
-      : type(type) {}
+      : type(type) {
+      if (stats::counters) [[unlikely]] {
+         ++stats::counters->allocations[int(type)];
+      }
+   }
    virtual ~ValueLiteral() = default;
 
-   void print() const {
-      std::cout << as_string();
-   }
    virtual std::string as_string() const = 0;
    virtual long as_number() const = 0;
    virtual bool as_bool() const = 0;
 };
 
-// Number value
+// Tagged value
+//
+// Numbers and Nil are stored inline and never touch the heap, every other type holds a counted
+// pointer to its heap object.
 
-struct NumberValue : public ValueLiteral {
-   long number;
+struct Value {
+   ValueType type;
 
-   NumberValue(long number)
-      : number(number), ValueLiteral(ValueType::number) {}
-   
-   static Value make(long number) {
-      return std::make_shared<NumberValue>(number);
+private:
+   union {
+      long number;
+      ValueLiteral* object;
+   };
+
+   bool is_object() const { return type != ValueType::number && type != ValueType::null; }
+   void retain() const { if (is_object()) ++object->refs; }
+   void release() const { if (is_object() && --object->refs == 0) delete object; }
+
+public:
+   Value()
+      : type(ValueType::null), number(0) {}
+   explicit Value(long number)
+      : type(ValueType::number), number(number) {}
+   explicit Value(ValueLiteral* object)
+      : type(object->type), object(object) { retain(); }
+
+   Value(const Value& other)
+      : type(other.type), number(other.number) { retain(); }
+   Value(Value&& other) noexcept
+      : type(other.type), number(other.number) { other.type = ValueType::null; }
+   ~Value() { release(); }
+
+   Value& operator=(const Value& other) {
+      other.retain();
+      release();
+      type = other.type;
+      number = other.number;
+      return *this;
+   }
+
+   Value& operator=(Value&& other) noexcept {
+      if (this != &other) {
+         release();
+         type = other.type;
+         number = other.number;
+         other.type = ValueType::null;
+      }
+      return *this;
    }
 
-   std::string as_string() const override { return std::to_string(number); }
-   long as_number() const override { return number; }
-   bool as_bool() const override { return number; }
+   template<typename T>
+   T& as() const { return static_cast<T&>(*object); }
+
+   void print() const {
+      std::cout << as_string();
+   }
+
+   std::string as_string() const {
+      switch (type) {
+      case ValueType::number: return std::to_string(number);
+      case ValueType::null:   return "";
+      default:                return object->as_string();
+      }
+   }
+
+   long as_number() const {
+      switch (type) {
+      case ValueType::number: return number;
+      case ValueType::null:   return 0;
+      default:                return object->as_number();
+      }
+   }
+
+   bool as_bool() const {
+      switch (type) {
+      case ValueType::number: return number;
+      case ValueType::null:   return false;
+      default:                return object->as_bool();
+      }
+   }
+};
+
+// Number value
+
+struct NumberValue {
+   static Value make(long number) {
+      return Value(number);
+   }
 };
 
 // String value
@@ -52,9 +130,9 @@ struct StringValue : public ValueLiteral {
 
    StringValue(const std::string& string)
       : string(string), ValueLiteral(ValueType::string) {}
-   
+
    static Value make(const std::string& string) {
-      return std::make_shared<StringValue>(string);
+      return Value(new StringValue(string));
    }
 
    std::string as_string() const override { return string; }
@@ -65,22 +143,26 @@ struct StringValue : public ValueLiteral {
 // Function value
 
 struct Environment;
+struct Chunk;
 
 struct Fn : public ValueLiteral {
-   std::string identifier;
-   std::vector<std::string> params;
+   Symbol identifier;
+   std::vector<Symbol> params;
+   std::shared_ptr<Scope> scope;
    Environment* env;
-   Stmt body;
+   std::shared_ptr<const Ast> ast;
+   NodeId body;
+   const Chunk* code;
 
-   Fn(const std::string& identifier, const std::vector<std::string>& params, Environment* env, Stmt body)
-      : identifier(identifier), params(params), env(env), body(body), ValueLiteral(ValueType::fn) {}
-   
-   static Value make(const std::string& identifier, const std::vector<std::string>& params, Environment* env, Stmt body) {
-      return std::make_shared<Fn>(identifier, params, env, body);
+   Fn(Symbol identifier, const std::vector<Symbol>& params, std::shared_ptr<Scope> scope, Environment* env, std::shared_ptr<const Ast> ast, NodeId body, const Chunk* code = nullptr)
+      : identifier(identifier), params(params), scope(scope), env(env), ast(std::move(ast)), body(body), code(code), ValueLiteral(ValueType::fn) {}
+
+   static Value make(Symbol identifier, const std::vector<Symbol>& params, std::shared_ptr<Scope> scope, Environment* env, std::shared_ptr<const Ast> ast, NodeId body, const Chunk* code = nullptr) {
+      return Value(new Fn(identifier, params, std::move(scope), env, std::move(ast), body, code));
    }
 
-   std::string as_string() const override { return identifier; }
-   long as_number() const override { return identifier.size(); }
+   std::string as_string() const override { return symbol::name(identifier); }
+   long as_number() const override { return symbol::name(identifier).size(); }
    bool as_bool() const override { return false; }
 };
 
@@ -90,16 +172,16 @@ struct Array : public ValueLiteral {
    std::vector<Value> array;
 
    Array(std::vector<Value> array)
-      : array(array), ValueLiteral(ValueType::array) {}
-   
+      : array(std::move(array)), ValueLiteral(ValueType::array) {}
+
    static Value make(std::vector<Value> array) {
-      return std::make_shared<Array>(array);
+      return Value(new Array(std::move(array)));
    }
 
    std::string as_string() const override {
       std::string result;
       for (const auto& element : array) {
-         result += element->as_string();
+         result += element.as_string();
       }
       return result;
    }
@@ -110,13 +192,8 @@ struct Array : public ValueLiteral {
 
 // Null value
 
-struct Null : public ValueLiteral {
-   Null() : ValueLiteral(ValueType::null) {}
-   static Value make() { return std::make_shared<Null>(); }
-
-   std::string as_string() const override { return ""; }
-   long as_number() const override { return 0; }
-   bool as_bool() const override { return false; }
+struct Null {
+   static Value make() { return Value(); }
 };
 
 #endif
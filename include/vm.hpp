@@ -0,0 +1,65 @@
+#ifndef VM_HPP
+#define VM_HPP
+
+// Includes
+
+#include "bytecode.hpp"
+#include "environment.hpp"
+#include "modules.hpp"
+#include <unordered_map>
+
+// VM
+//
+// Executes compiled chunks with a single dispatch loop. The VM keeps its own value stack for
+// statement results and its own stack of block scopes, and reports 'Break'/'Continue' raised in
+// a callee through 'flow' so that the caller can route it to the enclosing loop. Environments of
+// exited scopes are kept on a spare list and reset when the next scope is entered.
+//
+// Calls do not recurse on the native stack: every call pushes a frame holding the caller's
+// position and the callee's environment, so recursion depth is only limited by the memory the
+// frames and the value stack may take up.
+
+constexpr std::size_t default_recursion_memory = 256 << 20;
+
+class VM {
+   enum class Flow {
+      normal, brk, cont
+   };
+
+   struct Frame {
+      const Chunk* chunk;
+      const Instruction* ip;
+      std::size_t base, scope_base;
+      Environment* locals;
+      std::unique_ptr<Environment> env;
+      std::size_t memory;
+   };
+
+   std::vector<Value> values;
+   std::vector<Frame> frames;
+   std::vector<std::unique_ptr<Environment>> scopes, spare;
+   std::size_t memory = 0, memory_limit;
+   static constexpr std::size_t max_spare = 256;
+   std::vector<std::unique_ptr<Chunk>> modules;
+   std::unordered_map<std::shared_ptr<Module>, std::unique_ptr<Chunk>> imports;
+   long loops = 0;
+   Flow flow = Flow::normal;
+   Importer importer;
+
+   Value execute(const Chunk& chunk, Environment& env);
+   Value import(Environment& env, const std::string& code, const std::shared_ptr<const Bundle>& bundle);
+   std::unique_ptr<Environment> acquire(Environment* parent, const Scope* scope);
+   void release(std::unique_ptr<Environment> env);
+   static const Fn& callable(const Value& func, std::size_t count);
+
+public:
+   VM(bool fuse = true, bool import_once = false, std::size_t recursion_memory = default_recursion_memory);
+
+   Value run(const Ast& program, Environment& env);
+
+   // Names the file the program was read from, so that an import of it is caught as a cycle
+
+   void source(const std::string& path);
+};
+
+#endif
@@ -0,0 +1,91 @@
+#include "batch.hpp"
+
+// Includes
+
+#include "errors.hpp"
+#include "output.hpp"
+#include "pool.hpp"
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <vector>
+
+// Jobs
+
+namespace {
+   struct Job {
+      std::string script, input;
+      std::string output;
+      mei::Status status;
+   };
+
+   std::vector<Job> read_list(const std::string& path) {
+      std::ifstream file (path);
+      if (!file.is_open()) {
+         error::fail("Could not open batch list '" + path + "'.");
+      }
+
+      std::vector<Job> jobs;
+      for (std::string line; std::getline(file, line);) {
+         std::istringstream fields (line);
+         Job job;
+
+         if (fields >> job.script) {
+            fields >> job.input;
+            jobs.push_back(std::move(job));
+         }
+      }
+      return jobs;
+   }
+}
+
+// Functions
+
+namespace batch {
+   int run(const std::string& list, const mei::Options& options, unsigned threads) {
+      auto jobs = read_list(list);
+      mei::Cache programs (options);
+
+      std::vector<std::unique_ptr<mei::Instance>> instances;
+      for (unsigned i = 0; i < std::max(1u, threads); ++i) {
+         instances.push_back(std::make_unique<mei::Instance>(options));
+      }
+
+      pool::run(jobs.size(), threads, [&](unsigned worker, std::size_t index) {
+         auto& job = jobs[index];
+         std::string source, input;
+
+         if (!mei::read_file(job.script, source)) {
+            job.status = {1, "Could not open '" + job.script + "'."};
+            return;
+         }
+
+         if (!job.input.empty() && !mei::read_file(job.input, input)) {
+            job.status = {1, "Could not open '" + job.input + "'."};
+            return;
+         }
+
+         mei::Program program;
+         if (job.status = programs.get(source, program); !job.status.ok()) {
+            return;
+         }
+
+         auto& instance = *instances[worker];
+         job.status = instance.run(program, std::move(input), job.script);
+         job.output = instance.output();
+         instance.reset();
+      });
+
+      int status = 0;
+      for (auto& job : jobs) {
+         output::write(job.output.data(), job.output.size());
+         if (!job.status.ok()) {
+            std::cerr << job.script << ": " << job.status.error << '\n';
+            status = (status ? status : job.status.status);
+         }
+      }
+      return status;
+   }
+}
@@ -0,0 +1,320 @@
+#include "commands.hpp"
+
+// Includes
+
+#include "errors.hpp"
+#include "input.hpp"
+#include "output.hpp"
+#include <algorithm>
+#include <charconv>
+#include <limits>
+
+// Input and output commands
+
+namespace command {
+   Value read_number() {
+      output::flush_for_input();
+      int num = input::read_number();
+      stack::push(num);
+      return NumberValue::make(num);
+   }
+
+   Value read_key() {
+      output::flush_for_input();
+      char ch = input::read_key();
+      stack::push(ch);
+      return NumberValue::make(ch);
+   }
+
+   Value read_line() {
+      output::flush_for_input();
+      std::string string;
+      input::read_line(string);
+      stack::push_reversed(string.data(), string.size());
+      return StringValue::make(string);
+   }
+
+   Value print_char() {
+      if (stack::empty()) {
+         error::fail("',': Expected stack to not be empty.");
+      }
+      output::put(char(stack::pop()));
+      return Null::make();
+   }
+
+   Value print_number() {
+      if (stack::empty()) {
+         error::fail("'.': Expected stack to not be empty.");
+      }
+      char digits[24];
+      auto end = std::to_chars(digits, digits + sizeof(digits), stack::pop()).ptr;
+      output::write(digits, end - digits);
+      return Null::make();
+   }
+
+   void exit() {
+      error::exit();
+   }
+
+   void unknown(Type op) {
+      error::fail("Unknown command '" + std::to_string(int(op)) + "'.");
+   }
+
+   // Helper functions
+
+   void push_to_stack(Value value) {
+      if (value.type == ValueType::number) {
+         stack::push(value.as_number());
+      } else if (value.type == ValueType::array) {
+         auto& array = value.as<Array>();
+         for (auto& element : array.array) {
+            push_to_stack(element);
+         }
+      } else if (value.type != ValueType::null) {
+         auto string = value.as_string();
+         stack::push_reversed(string.data(), string.size());
+      } else {
+         error::fail("Invalid value to push to stack.");
+      }
+   }
+
+   void expected_values(const char* op, int count) {
+      if (count == 1) {
+         error::fail("'" + std::string(op) + "': Expected stack to not be empty.");
+      }
+      error::fail("'" + std::string(op) + "': Expected stack to have at least " + std::to_string(count) + " values.");
+   }
+
+   void division_by_zero() {
+      error::fail("Division by zero error.");
+   }
+
+   // Repeated commands
+   //
+   // 'op X n' is run in bulk whenever the stack is deep enough for every one of the 'n' runs to
+   // succeed, only the final result value is materialized. Anything else, including a stack that
+   // runs dry halfway through, takes the per run path so that partial output and errors match.
+
+   template<typename Function>
+   static long fold(long times, Function function) {
+      long result = stack::peek(0);
+      for (long i = 1; i <= times; ++i) {
+         result = function(stack::peek(i), result);
+      }
+      stack::drop(times);
+      stack::replace_top(result);
+      return result;
+   }
+
+   static long divisor(long value) {
+      if (value == 0) {
+         division_by_zero();
+      }
+      return value;
+   }
+
+   static Value repeat_bulk(Type op, long times) {
+      unsigned long size = stack::size();
+      unsigned long count = times;
+
+      switch (op) {
+      case Type::plus:
+         return NumberValue::make(fold(times, [](long b, long a) { return a + b; }));
+      case Type::hyphen:
+         return NumberValue::make(fold(times, [](long b, long a) { return b - a; }));
+      case Type::asterisk:
+         return NumberValue::make(fold(times, [](long b, long a) { return a * b; }));
+      case Type::slash:
+         return NumberValue::make(fold(times, [](long b, long a) { return b / divisor(a); }));
+      case Type::percent:
+         return NumberValue::make(fold(times, [](long b, long a) { return b % divisor(a); }));
+      case Type::equal:
+         return NumberValue::make(fold(times, [](long b, long a) { return long(a == b); }));
+      case Type::less:
+         return NumberValue::make(fold(times, [](long b, long a) { return long(a > b); }));
+      case Type::greater:
+         return NumberValue::make(fold(times, [](long b, long a) { return long(a < b); }));
+      case Type::colon: {
+         long value = stack::top();
+         stack::push_n(value, count);
+         return NumberValue::make(value);
+      }
+      case Type::dollar: {
+         long value = (count <= size ? stack::peek(count - 1) : 0);
+         stack::drop(std::min(count, size));
+         return NumberValue::make(value);
+      }
+      case Type::size:
+         stack::reserve(count);
+         for (unsigned long i = 0; i < count; ++i) {
+            stack::push(size + i);
+         }
+         return NumberValue::make(size + count - 1);
+      case Type::apostrophe:
+         if (times % 2) {
+            stack::replace_top(-stack::peek(0));
+         }
+         return NumberValue::make(stack::peek(0));
+      case Type::exclamation:
+         stack::replace_top(times % 2 ? !stack::peek(0) : stack::peek(0) != 0);
+         return NumberValue::make(stack::peek(0));
+      case Type::backslash:
+         if (times % 2) {
+            return swap();
+         }
+         return NumberValue::make(stack::peek(0));
+      case Type::caret:
+         for (long i = 0; i < times; ++i) {
+            long result = std::sqrt(stack::peek(0));
+            if (result == stack::peek(0)) {
+               break;
+            }
+            stack::replace_top(result);
+         }
+         return NumberValue::make(stack::peek(0));
+      case Type::comma: {
+         std::string text (count, '\0');
+         for (unsigned long i = 0; i < count; ++i) {
+            text[i] = char(stack::peek(i));
+         }
+         stack::drop(count);
+         output::write(text.data(), text.size());
+         return Null::make();
+      }
+      case Type::period: {
+         std::string text;
+         char digits[24];
+         for (unsigned long i = 0; i < count; ++i) {
+            auto end = std::to_chars(digits, digits + sizeof(digits), stack::peek(i)).ptr;
+            text.append(digits, end);
+         }
+         stack::drop(count);
+         output::write(text.data(), text.size());
+         return Null::make();
+      }
+      default:
+         return execute(op);
+      }
+   }
+
+   static unsigned long bulk_depth(Type op, long times) {
+      switch (op) {
+      case Type::plus: case Type::hyphen: case Type::asterisk: case Type::slash: case Type::percent:
+      case Type::equal: case Type::less: case Type::greater:
+         return static_cast<unsigned long>(times) + 1;
+      case Type::backslash:
+         return 2;
+      case Type::apostrophe: case Type::exclamation: case Type::caret:
+         return 1;
+      case Type::comma: case Type::period:
+         return times;
+      case Type::colon: case Type::dollar: case Type::size:
+         return 0;
+      default:
+         return std::numeric_limits<unsigned long>::max();
+      }
+   }
+
+   Value repeat(Type op, long times) {
+      if (times <= 0) {
+         return Null::make();
+      }
+
+      if (times > 1 && stack::size() >= bulk_depth(op, times)) {
+         return repeat_bulk(op, times);
+      }
+
+      Value final;
+      for (long i = 0; i < times; ++i) {
+         final = execute(op);
+      }
+      return final;
+   }
+
+   // Dispatch
+
+   Value execute(Type op) {
+      switch (op) {
+      case Type::tilde:
+         return read_number();
+      case Type::grave:
+         return read_key();
+      case Type::exclamation:
+         return logical_not();
+      case Type::at:
+         exit();
+      case Type::dollar:
+         return drop();
+      case Type::percent:
+         return modulo();
+      case Type::caret:
+         return square_root();
+      case Type::ampersand:
+         return read_line();
+      case Type::asterisk:
+         return multiply();
+      case Type::hyphen:
+         return subtract();
+      case Type::plus:
+         return add();
+      case Type::equal:
+         return equal();
+      case Type::backslash:
+         return swap();
+      case Type::colon:
+         return duplicate();
+      case Type::apostrophe:
+         return negate();
+      case Type::comma:
+         return print_char();
+      case Type::less:
+         return less();
+      case Type::greater:
+         return greater();
+      case Type::period:
+         return print_number();
+      case Type::slash:
+         return divide();
+      case Type::size:
+         return size();
+      case Type::set_reg:
+         return set_register();
+      case Type::get_reg:
+         return get_register();
+      case Type::lor:
+         return logical_or();
+      case Type::land:
+         return logical_and();
+      default:
+         unknown(op);
+      }
+   }
+
+   Value execute(Fusion fusion, long operand) {
+      switch (fusion) {
+      case Fusion::dup_multiply:
+         return dup_multiply();
+      case Fusion::swap_subtract:
+         return swap_subtract();
+      case Fusion::equal_not:
+         return equal_not();
+      case Fusion::push_add:
+         return push_add(operand);
+      case Fusion::push_subtract:
+         return push_subtract(operand);
+      case Fusion::push_multiply:
+         return push_multiply(operand);
+      case Fusion::push_divide:
+         return push_divide(operand);
+      case Fusion::push_modulo:
+         return push_modulo(operand);
+      case Fusion::push_equal:
+         return push_equal(operand);
+      case Fusion::push_less:
+         return push_less(operand);
+      case Fusion::push_greater:
+         return push_greater(operand);
+      }
+      return Null::make();
+   }
+}
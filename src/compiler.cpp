@@ -0,0 +1,389 @@
+#include "compiler.hpp"
+
+// Includes
+
+#include "errors.hpp"
+
+// Compiler
+
+Compiler::Compiler(Chunk& chunk, const Ast& ast)
+   : chunk(chunk), ast(ast) {
+   chunk.bundle = ast.bundle;
+}
+
+void Compiler::compile() {
+   compile_block(ast.list(ast[ast.root].c), true);
+   emit(Op::ret);
+}
+
+void Compiler::compile_body(NodeId body) {
+   if (ast[body].type == StmtType::program) {
+      compile_block(ast.list(ast[body].c), true);
+   } else {
+      compile_stmt(ast[body], true);
+   }
+   emit(Op::ret);
+}
+
+// Compile functions
+
+void Compiler::compile_stmt(const Node& node, bool keep) {
+   error::check_stack("Program is nested too deeply.");
+
+   switch (node.type) {
+   case StmtType::var_decl:
+      compile_var_decl(node);
+      break;
+   case StmtType::fn_decl:
+      compile_fn_decl(node);
+      break;
+   case StmtType::while_loop:
+      compile_while_loop(node);
+      break;
+   case StmtType::break_stmt:
+      compile_break(true);
+      break;
+   case StmtType::continue_stmt:
+      compile_break(false);
+      break;
+   case StmtType::import:
+      compile_stmt(ast[node.a], true);
+      emit(Op::import, 0, handler());
+      break;
+   case StmtType::push:
+      compile_stmt(ast[node.a], true);
+      emit(Op::push);
+      break;
+   case StmtType::type:
+      compile_stmt(ast[node.a], true);
+      emit(Op::type);
+      break;
+   case StmtType::pull:
+      emit(Op::pull);
+      break;
+   case StmtType::ternary:
+      compile_ternary_expr(node, keep);
+      return;
+   case StmtType::call:
+      compile_call_expr(node);
+      break;
+   case StmtType::command:
+      compile_command(node, keep);
+      return;
+   case StmtType::fused:
+      compile_fused_command(node, keep);
+      return;
+   case StmtType::identifier:
+      compile_identifier(node);
+      break;
+   case StmtType::number:
+      emit(Op::push_const, add_constant(NumberValue::make(node.number())));
+      break;
+   case StmtType::string:
+      emit(Op::push_const, add_constant(StringValue::make(ast.strings[node.a])));
+      break;
+   case StmtType::array: {
+      auto elements = ast.list(node.c);
+      for (auto element : elements) {
+         compile_stmt(ast[element], true);
+      }
+      emit(Op::make_array, elements.size());
+      break;
+   }
+   case StmtType::program:
+      if (node.d == no_node) {
+         compile_block(ast.list(node.c), true);
+         break;
+      }
+      chunk.scopes.push_back(ast.scopes[node.d]);
+      emit(Op::enter_scope, chunk.scopes.size() - 1);
+      ++scopes;
+      compile_block(ast.list(node.c), true);
+      emit(Op::exit_scope, 1);
+      --scopes;
+      break;
+   }
+
+   if (!keep) {
+      emit(Op::pop);
+   }
+}
+
+void Compiler::compile_block(std::span<const NodeId> stmts, bool keep) {
+   if (stmts.empty()) {
+      if (keep) {
+         emit(Op::push_nil);
+      }
+      return;
+   }
+
+   for (std::size_t i = 0; i < stmts.size(); ++i) {
+      compile_stmt(ast[stmts[i]], keep && i + 1 == stmts.size());
+   }
+}
+
+void Compiler::compile_var_decl(const Node& decl) {
+   compile_stmt(ast[decl.b], true);
+
+   if (ast[decl.a].type != StmtType::identifier) {
+      error("Expected identifier in variable declaration.");
+      return;
+   }
+   compile_define(ast[decl.a]);
+}
+
+void Compiler::compile_fn_decl(const Node& decl) {
+   auto proto = std::make_unique<FnProto>();
+
+   for (auto param : ast.list(decl.c)) {
+      if (ast[param].type != StmtType::identifier) {
+         error("Expected identifier in function declaration parameter list.");
+         emit(Op::push_nil);
+         return;
+      }
+      proto->params.push_back(ast[param].a);
+   }
+
+   if (ast[decl.a].type != StmtType::identifier) {
+      error("Expected identifier in function declaration.");
+      emit(Op::push_nil);
+      return;
+   }
+   auto& ident = ast[decl.a];
+   proto->identifier = ident.a;
+   proto->scope = ast.scopes[decl.d];
+
+   Compiler compiler (proto->chunk, ast);
+   compiler.compile_body(decl.b);
+
+   chunk.functions.push_back(std::move(proto));
+   emit(Op::make_fn, chunk.functions.size() - 1);
+   compile_define(ident);
+}
+
+void Compiler::compile_while_loop(const Node& whl) {
+   emit(Op::loop_enter);
+   emit(Op::push_nil);
+
+   auto top = here();
+   auto test = emit(Op::loop_test);
+   emit(Op::pop);
+   loops.push_back({depth, scopes, top, {test}, {}});
+
+   compile_stmt(ast[whl.a], true);
+   emit(Op::jump, top);
+
+   auto end = here();
+   for (auto at : loops.back().breaks) {
+      chunk.code[at].a = end;
+   }
+
+   for (auto index : loops.back().handlers) {
+      chunk.handlers[index].break_target = end;
+   }
+   loops.pop_back();
+   emit(Op::loop_exit);
+}
+
+void Compiler::compile_break(bool is_break) {
+   if (loops.empty()) {
+      emit((is_break ? Op::break_dyn : Op::continue_dyn));
+      ++depth;
+      return;
+   }
+
+   auto& loop = loops.back();
+   auto saved = depth;
+   if (depth > loop.depth) {
+      emit(Op::drop, depth - loop.depth);
+   }
+
+   if (scopes > loop.scopes) {
+      emit(Op::exit_scope, scopes - loop.scopes);
+   }
+   emit(Op::push_nil);
+
+   if (is_break) {
+      loop.breaks.push_back(emit(Op::jump));
+   } else {
+      emit(Op::jump, loop.top);
+   }
+   depth = saved + 1;
+}
+
+void Compiler::compile_call_expr(const Node& call) {
+   auto args = ast.list(call.c);
+   for (auto arg : args) {
+      compile_stmt(ast[arg], true);
+   }
+
+   if (ast[call.a].type != StmtType::identifier) {
+      compile_call_expr(ast[call.a]);
+   } else {
+      compile_identifier(ast[call.a]);
+   }
+   if (call.op == tail_call) {
+      emit(Op::tail_call, args.size());
+   } else {
+      emit(Op::call, args.size(), handler());
+   }
+}
+
+void Compiler::compile_command(const Node& command, bool keep) {
+   auto repeated = (command.a != no_node);
+   if (repeated) {
+      compile_stmt(ast[command.a], true);
+   }
+   auto op = command_op(Type(command.op));
+   if (op != Op::unknown) {
+      emit(op, repeated, !keep);
+      return;
+   }
+
+   emit(Op::unknown, repeated, int(command.op));
+   if (!keep) {
+      emit(Op::pop);
+   }
+}
+
+void Compiler::compile_fused_command(const Node& fused, bool keep) {
+   emit(fused_op(Fusion(fused.op)), fused.number(), !keep);
+}
+
+void Compiler::compile_identifier(const Node& ident) {
+   if (ident.slot() != -1) {
+      emit(Op::load_slot, ident.depth(), ident.slot(), ident.a);
+   } else {
+      emit(Op::load, ident.a);
+   }
+}
+
+void Compiler::compile_define(const Node& ident) {
+   if (ident.slot() != -1) {
+      emit(Op::define_slot, ident.depth(), ident.slot());
+   } else {
+      emit(Op::define, ident.a);
+   }
+}
+
+void Compiler::compile_ternary_expr(const Node& ternary, bool keep) {
+   auto branch = emit(Op::branch);
+   auto saved = depth;
+
+   compile_stmt(ast[ternary.a], keep);
+   auto jump = emit(Op::jump);
+   chunk.code[branch].a = here();
+
+   depth = saved;
+   compile_stmt(ast[ternary.b], keep);
+   chunk.code[jump].a = here();
+}
+
+// Helper functions
+
+std::size_t Compiler::emit(Op op, std::int32_t a, std::int32_t b, std::int32_t c) {
+   switch (op) {
+   case Op::push_const: case Op::push_nil: case Op::load: case Op::load_slot: case Op::make_fn:
+   case Op::pull:
+      ++depth;
+      break;
+   case Op::pop: case Op::ret:
+      --depth;
+      break;
+   case Op::drop:
+      depth -= a;
+      break;
+   case Op::make_array:
+      depth += 1 - a;
+      break;
+   case Op::call: case Op::tail_call:
+      depth -= a;
+      break;
+   case Op::unknown:
+      depth += 1 - a;
+      break;
+   default:
+      if (op > Op::unknown) {
+         depth += (b ? 0 : 1);
+      } else if (op >= Op::read_number) {
+         depth += (b ? 0 : 1) - a;
+      }
+      break;
+   }
+
+   chunk.code.push_back({op, a, b, c});
+   return chunk.code.size() - 1;
+}
+
+std::int32_t Compiler::here() const {
+   return chunk.code.size();
+}
+
+std::int32_t Compiler::handler() {
+   if (loops.empty()) {
+      return -1;
+   }
+
+   auto& loop = loops.back();
+   chunk.handlers.push_back({loop.depth, loop.scopes, -1, loop.top});
+   loop.handlers.push_back(chunk.handlers.size() - 1);
+   return loop.handlers.back();
+}
+
+std::int32_t Compiler::add_constant(Value value) {
+   chunk.constants.push_back(value);
+   return chunk.constants.size() - 1;
+}
+
+void Compiler::error(const std::string& message) {
+   emit(Op::error, add_constant(StringValue::make(message)));
+}
+
+// Helper functions
+
+Op command_op(Type type) {
+   switch (type) {
+   case Type::tilde:       return Op::read_number;
+   case Type::grave:       return Op::read_key;
+   case Type::exclamation: return Op::logical_not;
+   case Type::at:          return Op::exit;
+   case Type::dollar:      return Op::drop_stack;
+   case Type::percent:     return Op::modulo;
+   case Type::caret:       return Op::square_root;
+   case Type::ampersand:   return Op::read_line;
+   case Type::asterisk:    return Op::multiply;
+   case Type::hyphen:      return Op::subtract;
+   case Type::plus:        return Op::add;
+   case Type::equal:       return Op::equal;
+   case Type::backslash:   return Op::swap;
+   case Type::colon:       return Op::duplicate;
+   case Type::apostrophe:  return Op::negate;
+   case Type::comma:       return Op::print_char;
+   case Type::less:        return Op::less;
+   case Type::greater:     return Op::greater;
+   case Type::period:      return Op::print_number;
+   case Type::slash:       return Op::divide;
+   case Type::size:        return Op::size;
+   case Type::set_reg:     return Op::set_register;
+   case Type::get_reg:     return Op::get_register;
+   case Type::lor:         return Op::logical_or;
+   case Type::land:        return Op::logical_and;
+   default:                return Op::unknown;
+   }
+}
+
+Op fused_op(Fusion fusion) {
+   switch (fusion) {
+   case Fusion::dup_multiply:  return Op::dup_multiply;
+   case Fusion::swap_subtract: return Op::swap_subtract;
+   case Fusion::equal_not:     return Op::equal_not;
+   case Fusion::push_add:      return Op::push_add;
+   case Fusion::push_subtract: return Op::push_subtract;
+   case Fusion::push_multiply: return Op::push_multiply;
+   case Fusion::push_divide:   return Op::push_divide;
+   case Fusion::push_modulo:   return Op::push_modulo;
+   case Fusion::push_equal:    return Op::push_equal;
+   case Fusion::push_less:     return Op::push_less;
+   default:                    return Op::push_greater;
+   }
+}
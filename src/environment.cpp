@@ -1,42 +1,169 @@
 #include "environment.hpp"
 
+// Includes
+
+#include "errors.hpp"
+#include "stats.hpp"
+#include <algorithm>
+
+// Scope
+
+int Scope::declare(Symbol name) {
+   if (auto slot = slots.find(name)) {
+      return *slot;
+   }
+   return add(name);
+}
+
+int Scope::add(Symbol name) {
+   names.push_back(name);
+   return slots[name] = names.size() - 1;
+}
+
+int Scope::find(Symbol name) const {
+   auto slot = slots.find(name);
+   return (slot ? *slot : -1);
+}
+
 // Environment
 
-Environment::Environment(Environment* parent)
-   : parent(parent) {}
+namespace {
+   thread_local std::uint64_t revisions = 0;
 
-Environment::Environment()
-   : parent(nullptr) {
-   set("No", NumberValue::make(0));
-   set("Yes", NumberValue::make(1));
-   set("Nil", Null::make());
+   void count_lookup(std::uint64_t steps) {
+      if (auto counters = stats::counters) [[unlikely]] {
+         ++counters->lookups;
+         counters->lookup_steps += steps;
+         counters->longest_lookup = std::max(counters->longest_lookup, steps);
+      }
+   }
+}
 
-   set("Number_t", NumberValue::make(0));
-   set("String_t", NumberValue::make(1));
-   set("Fun_t", NumberValue::make(2));
-   set("Array_t", NumberValue::make(3));
-   set("Nil_t", NumberValue::make(4));
+Environment::Environment(Environment* parent, const Scope* scope)
+   : parent(parent), scope(scope), revision(++revisions) {
+   if (stats::counters) [[unlikely]] {
+      ++stats::counters->environments;
+   }
+
+   if (scope) {
+      slots.resize(scope->names.size());
+   }
+}
+
+Environment::Environment(const Scope* scope)
+   : Environment(nullptr, scope) {
+   for (auto& [name, value] : builtins()) {
+      set(name, value);
+   }
+}
+
+// Drops every binding so that the environment can stand in for a freshly constructed one
+
+void Environment::reset(Environment* parent, const Scope* scope) {
+   this->parent = parent;
+   this->scope = scope;
+   revision = ++revisions;
+
+   if (stats::counters) [[unlikely]] {
+      ++stats::counters->reuses;
+   }
+   slots.assign((scope ? scope->names.size() : 0), {});
+
+   if (vars.size()) {
+      vars.clear();
+   }
+}
+
+// Approximate footprint, not counting names bound outside the scope
+
+std::size_t Environment::memory() const {
+   return sizeof(Environment) + slots.capacity() * sizeof(Binding);
 }
 
 // Functions
 
-void Environment::set(const std::string& identifier, Value value) {
+void Environment::set(Symbol identifier, Value value) {
+   if (scope) {
+      if (auto slot = scope->find(identifier); slot != -1) {
+         set_slot(slot, std::move(value));
+         return;
+      }
+   }
    vars[identifier] = value;
+   revision = ++revisions;
+}
+
+void Environment::set_slot(int slot, Value value) {
+   slots[slot] = {std::move(value), true};
+   revision = ++revisions;
 }
 
-Value Environment::get(const std::string& identifier) {
-   auto& env = resolve(identifier);
-   return env.vars[identifier];
+Environment* Environment::ancestor(int depth) {
+   auto env = this;
+   for (int i = 0; i < depth; ++i) {
+      env = env->parent;
+   }
+   return env;
+}
+
+Value Environment::get(Symbol identifier) {
+   std::uint64_t steps = 0;
+   for (auto env = this; env; env = env->parent) {
+      ++steps;
+      if (auto value = env->find(identifier)) {
+         count_lookup(steps);
+         return *value;
+      }
+   }
+
+   error::fail("Variable '" + symbol::name(identifier) + "' does not exist.");
 }
 
-Environment& Environment::resolve(const std::string& identifier) {
-   if (vars.find(identifier) != vars.end()) {
-      return *this;
+Value Environment::get(int depth, int slot, Symbol identifier) {
+   if (stats::counters) [[unlikely]] {
+      ++stats::counters->slot_reads[std::min(depth, stats::depths - 1)];
+   }
+
+   auto env = this;
+   for (int i = 0; i < depth; ++i) {
+      env = env->parent;
+   }
+
+   if (auto& binding = env->slots[slot]; binding.defined) {
+      return binding.value;
+   }
+
+   // The declaration has not run yet, so the name can only be bound further out
+
+   if (!env->parent) {
+      error::fail("Variable '" + symbol::name(identifier) + "' does not exist.");
    }
+   return env->parent->get(identifier);
+}
 
-   if (!parent) {
-      std::cerr << "Variable '" << identifier << "' does not exist.\n";
-      std::exit(1);
+Value* Environment::find(Symbol identifier) {
+   if (scope) {
+      if (auto slot = scope->find(identifier); slot != -1 && slots[slot].defined) {
+         return &slots[slot].value;
+      }
    }
-   return parent->resolve(identifier);
+
+   return vars.find(identifier);
+}
+
+// Builtins
+
+const std::vector<std::pair<Symbol, Value>>& builtins() {
+   static const std::vector<std::pair<Symbol, Value>> builtins {
+      {symbol::intern("No"), NumberValue::make(0)},
+      {symbol::intern("Yes"), NumberValue::make(1)},
+      {symbol::intern("Nil"), Null::make()},
+
+      {symbol::intern("Number_t"), NumberValue::make(0)},
+      {symbol::intern("String_t"), NumberValue::make(1)},
+      {symbol::intern("Fun_t"), NumberValue::make(2)},
+      {symbol::intern("Array_t"), NumberValue::make(3)},
+      {symbol::intern("Nil_t"), NumberValue::make(4)},
+   };
+   return builtins;
 }
@@ -0,0 +1,42 @@
+#include "errors.hpp"
+
+// Includes
+
+#include <algorithm>
+#include <pthread.h>
+
+// Functions
+
+namespace error {
+   constinit thread_local std::uintptr_t stack_floor = UINTPTR_MAX;
+
+   void fail(const std::string& message) {
+      throw Exit{1, message};
+   }
+
+   void exit() {
+      throw Exit{0, {}};
+   }
+
+   void check_stack_slow(const char* message) {
+      if (stack_floor == UINTPTR_MAX) {
+         pthread_attr_t attributes;
+         void* low = nullptr;
+         std::size_t size = 0;
+
+         if (pthread_getattr_np(pthread_self(), &attributes) == 0) {
+            pthread_attr_getstack(&attributes, &low, &size);
+            pthread_attr_destroy(&attributes);
+         }
+
+         // A thread whose stack cannot be found is not checked
+
+         stack_floor = (low ? std::uintptr_t(low) + std::min(size / 2, stack_reserve) : 0);
+      }
+
+      char marker;
+      if (std::uintptr_t(&marker) < stack_floor) {
+         fail(message);
+      }
+   }
+}
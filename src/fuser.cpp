@@ -0,0 +1,140 @@
+#include "fuser.hpp"
+
+// Includes
+
+#include "errors.hpp"
+#include <cstdint>
+#include <limits>
+
+// Fuser
+
+void Fuser::fuse(Ast& program) {
+   ast = &program;
+   fuse_block(program[program.root].c);
+}
+
+// Fuse functions
+
+void Fuser::fuse_stmt(NodeId id) {
+   error::check_stack("Program is nested too deeply.");
+
+   // Fusing appends nodes, so the node is copied rather than held by reference
+
+   auto node = (*ast)[id];
+
+   switch (node.type) {
+   case StmtType::var_decl:
+   case StmtType::fn_decl:
+      fuse_stmt(node.b);
+      break;
+   case StmtType::while_loop:
+   case StmtType::import:
+   case StmtType::push:
+   case StmtType::type:
+      fuse_stmt(node.a);
+      break;
+   case StmtType::ternary:
+      fuse_stmt(node.a);
+      fuse_stmt(node.b);
+      break;
+   case StmtType::call:
+      for (auto arg : ast->list(node.c)) {
+         fuse_stmt(arg);
+      }
+      fuse_stmt(node.a);
+      break;
+   case StmtType::command:
+      if (node.a != no_node) {
+         fuse_stmt(node.a);
+      }
+      break;
+   case StmtType::array:
+      for (auto element : ast->list(node.c)) {
+         fuse_stmt(element);
+      }
+      break;
+   case StmtType::program:
+      fuse_block(node.c);
+      break;
+   default:
+      break;
+   }
+}
+
+// Compacts the list in place, a list never grows so the count at its head is simply lowered
+
+void Fuser::fuse_block(std::uint32_t list) {
+   auto stmts = ast->list(list);
+   std::size_t out = 0;
+
+   for (std::size_t i = 0; i < stmts.size(); ++i) {
+      fuse_stmt(stmts[i]);
+
+      if (i + 1 < stmts.size()) {
+         if (auto fused = match(stmts[i], stmts[i + 1]); fused != no_node) {
+            stmts[out++] = fused;
+            ++i;
+            continue;
+         }
+      }
+      stmts[out++] = stmts[i];
+   }
+   ast->lists[list] = out;
+}
+
+// Helper functions
+
+NodeId Fuser::match(NodeId first_id, NodeId second_id) {
+   auto first = (*ast)[first_id], second = (*ast)[second_id];
+   if (second.type != StmtType::command || second.a != no_node) {
+      return no_node;
+   }
+   auto op = Type(second.op);
+
+   auto make = [&](Fusion fusion, long operand = 0) {
+      Node fused {StmtType::fused, std::uint8_t(fusion)};
+      fused.set_number(operand);
+      return ast->add(fused);
+   };
+
+   if (first.type == StmtType::command) {
+      if (first.a != no_node) {
+         return no_node;
+      }
+
+      if (Type(first.op) == Type::colon && op == Type::asterisk) {
+         return make(Fusion::dup_multiply);
+      } else if (Type(first.op) == Type::backslash && op == Type::hyphen) {
+         return make(Fusion::swap_subtract);
+      } else if (Type(first.op) == Type::equal && op == Type::exclamation) {
+         return make(Fusion::equal_not);
+      }
+      return no_node;
+   }
+
+   if (first.type != StmtType::push) {
+      return no_node;
+   }
+
+   auto& literal = (*ast)[first.a];
+   if (literal.type != StmtType::number) {
+      return no_node;
+   }
+
+   auto number = literal.number();
+   if (number < std::numeric_limits<std::int32_t>::min() || number > std::numeric_limits<std::int32_t>::max()) {
+      return no_node;
+   }
+
+   switch (op) {
+   case Type::plus:     return make(Fusion::push_add, number);
+   case Type::hyphen:   return make(Fusion::push_subtract, number);
+   case Type::asterisk: return make(Fusion::push_multiply, number);
+   case Type::slash:    return make(Fusion::push_divide, number);
+   case Type::percent:  return make(Fusion::push_modulo, number);
+   case Type::equal:    return make(Fusion::push_equal, number);
+   case Type::less:     return make(Fusion::push_less, number);
+   case Type::greater:  return make(Fusion::push_greater, number);
+   default:             return no_node;
+   }
+}
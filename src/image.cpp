@@ -0,0 +1,404 @@
+#include "image.hpp"
+
+// Includes
+
+#include "errors.hpp"
+#include "lexer.hpp"
+#include "parser.hpp"
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+
+// Format
+//
+// Header, then the module table and the symbol spans, followed by each module's nodes, child lists
+// and string spans in table order, and finally the raw bytes the spans point into. Nodes are
+// stored exactly as they are laid out in memory, a child always has a lower index than its parent.
+
+namespace {
+   constexpr std::uint32_t none = 0xffffffff;
+   constexpr std::uint32_t byte_order = 0x01020304;
+
+   struct Span {
+      std::uint32_t offset, length;
+   };
+
+   struct Header {
+      char magic[4];
+      std::uint32_t version, byte_order;
+      std::uint32_t modules, symbols, bytes;
+   };
+
+   struct ModuleEntry {
+      Span name;
+      std::uint32_t root, nodes, lists, strings;
+   };
+}
+
+// Writer
+
+namespace {
+   class Writer {
+      std::vector<ModuleEntry> modules;
+      std::vector<Span> symbols;
+      std::vector<Node> nodes;
+      std::vector<std::uint32_t> lists;
+      std::vector<Span> strings;
+      std::string bytes;
+      std::unordered_map<Symbol, std::uint32_t> symbol_indices;
+
+      Span add_bytes(std::string_view data) {
+         Span span {std::uint32_t(bytes.size()), std::uint32_t(data.size())};
+         bytes.append(data);
+         return span;
+      }
+
+      std::uint32_t add_symbol(Symbol symbol) {
+         auto [it, inserted] = symbol_indices.try_emplace(symbol, symbols.size());
+         if (inserted) {
+            symbols.push_back(add_bytes(symbol::name(symbol)));
+         }
+         return it->second;
+      }
+
+      template<typename T>
+      static void write_section(std::ofstream& file, const std::vector<T>& section) {
+         file.write(reinterpret_cast<const char*>(section.data()), section.size() * sizeof(T));
+      }
+
+   public:
+      void add_module(const std::string& name, const Ast& program) {
+         modules.push_back({
+            (name.empty() ? Span {none, 0} : add_bytes(name)), program.root,
+            std::uint32_t(program.nodes.size()), std::uint32_t(program.lists.size()), std::uint32_t(program.strings.size())
+         });
+
+         for (auto node : program.nodes) {
+            switch (node.type) {
+            case StmtType::identifier:
+               node.a = add_symbol(node.a);
+               node.b = node.c = no_node;
+               break;
+            case StmtType::fn_decl:
+            case StmtType::program:
+            case StmtType::call:
+               node.d = no_node;
+               break;
+            case StmtType::fused:
+               error::fail("Fused commands cannot be written to a program image.");
+            default:
+               break;
+            }
+            nodes.push_back(node);
+         }
+         lists.insert(lists.end(), program.lists.begin(), program.lists.end());
+
+         for (auto& string : program.strings) {
+            strings.push_back(add_bytes(string));
+         }
+      }
+
+      void write(const std::string& path) {
+         Header header {
+            {image::magic[0], image::magic[1], image::magic[2], image::magic[3]},
+            image::version, byte_order,
+            std::uint32_t(modules.size()), std::uint32_t(symbols.size()), std::uint32_t(bytes.size())
+         };
+
+         std::ofstream file (path, std::ios::binary | std::ios::trunc);
+         if (!file.is_open()) {
+            error::fail("Could not open '" + path + "' for writing.");
+         }
+
+         file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+         write_section(file, modules);
+         write_section(file, symbols);
+
+         std::size_t node = 0, list = 0, string = 0;
+         for (auto& module : modules) {
+            file.write(reinterpret_cast<const char*>(nodes.data() + node), module.nodes * sizeof(Node));
+            file.write(reinterpret_cast<const char*>(lists.data() + list), module.lists * sizeof(std::uint32_t));
+            file.write(reinterpret_cast<const char*>(strings.data() + string), module.strings * sizeof(Span));
+            node += module.nodes;
+            list += module.lists;
+            string += module.strings;
+         }
+         file.write(bytes.data(), bytes.size());
+
+         if (!file.good()) {
+            error::fail("Could not write '" + path + "'.");
+         }
+      }
+   };
+}
+
+// Reader
+
+namespace {
+   class Reader {
+      const std::string& path;
+      Header header;
+      const char* bytes;
+      std::vector<Symbol> interned;
+
+      [[noreturn]] void invalid() {
+         error::fail("Invalid program image '" + path + "'.");
+      }
+
+      std::string_view get_bytes(Span span) {
+         if (span.offset > header.bytes || span.length > header.bytes - span.offset) {
+            invalid();
+         }
+         return {bytes + span.offset, span.length};
+      }
+
+      void check_child(std::uint32_t index, std::uint32_t parent) {
+         if (index >= parent) {
+            invalid();
+         }
+      }
+
+      void check_list(const Ast& ast, std::uint32_t offset, std::uint32_t parent) {
+         if (offset >= ast.lists.size() || ast.lists[offset] > ast.lists.size() - offset - 1) {
+            invalid();
+         }
+
+         for (auto child : ast.list(offset)) {
+            check_child(child, parent);
+         }
+      }
+
+      // Copies a module's arena out of the image, then checks every node in a single pass and
+      // maps its symbol indices back to interned symbols
+
+      std::shared_ptr<Ast> read_module(const ModuleEntry& entry, const char*& at) {
+         auto ast = std::make_shared<Ast>();
+         auto nodes = reinterpret_cast<const Node*>(at);
+         auto lists = reinterpret_cast<const std::uint32_t*>(at += entry.nodes * sizeof(Node));
+         auto strings = reinterpret_cast<const Span*>(at += entry.lists * sizeof(std::uint32_t));
+         at += entry.strings * sizeof(Span);
+
+         ast->nodes.assign(nodes, nodes + entry.nodes);
+         ast->lists.assign(lists, lists + entry.lists);
+         ast->strings.reserve(entry.strings);
+         for (std::uint32_t i = 0; i < entry.strings; ++i) {
+            ast->strings.emplace_back(get_bytes(strings[i]));
+         }
+
+         for (std::uint32_t i = 0; i < entry.nodes; ++i) {
+            auto& node = ast->nodes[i];
+
+            switch (node.type) {
+            case StmtType::var_decl:
+            case StmtType::ternary:
+               check_child(node.a, i);
+               check_child(node.b, i);
+               break;
+            case StmtType::fn_decl:
+               check_child(node.a, i);
+               check_child(node.b, i);
+               check_list(*ast, node.c, i);
+               node.d = no_node;
+               break;
+            case StmtType::while_loop:
+            case StmtType::import:
+            case StmtType::push:
+            case StmtType::type:
+               check_child(node.a, i);
+               break;
+            case StmtType::break_stmt:
+            case StmtType::continue_stmt:
+            case StmtType::pull:
+            case StmtType::number:
+               break;
+            case StmtType::call:
+               check_child(node.a, i);
+               check_list(*ast, node.c, i);
+               node.op = 0;
+               node.d = no_node;
+               break;
+            case StmtType::command:
+               if (node.op > std::uint8_t(Type::land) || (node.a != no_node && node.a >= i)) {
+                  invalid();
+               }
+               break;
+            case StmtType::identifier:
+               if (node.a >= interned.size()) {
+                  invalid();
+               }
+               node.a = interned[node.a];
+               node.b = node.c = no_node;
+               break;
+            case StmtType::string:
+               if (node.a >= entry.strings) {
+                  invalid();
+               }
+               break;
+            case StmtType::array:
+               check_list(*ast, node.c, i);
+               break;
+            case StmtType::program:
+               check_list(*ast, node.c, i);
+               node.d = no_node;
+               break;
+            default:
+               invalid();
+            }
+         }
+
+         if (entry.root >= entry.nodes || ast->nodes[entry.root].type != StmtType::program) {
+            invalid();
+         }
+         ast->root = entry.root;
+         return ast;
+      }
+
+   public:
+      Reader(const std::string& path)
+         : path(path) {}
+
+      std::shared_ptr<Ast> read(const char* data, std::size_t size, image::Imports& imports) {
+         if (size < sizeof(Header)) {
+            invalid();
+         }
+         std::memcpy(&header, data, sizeof(Header));
+
+         if (std::memcmp(header.magic, image::magic, 4) != 0 || header.byte_order != byte_order) {
+            invalid();
+         }
+
+         if (header.version != image::version) {
+            error::fail("Program image '" + path + "' has version " + std::to_string(header.version) + ", expected " + std::to_string(image::version) + ".");
+         }
+
+         std::uint64_t expected = sizeof(Header) + std::uint64_t(header.modules) * sizeof(ModuleEntry) +
+            std::uint64_t(header.symbols) * sizeof(Span) + header.bytes;
+         if (expected > size || header.modules == 0) {
+            invalid();
+         }
+
+         auto modules = reinterpret_cast<const ModuleEntry*>(data + sizeof(Header));
+         for (std::uint32_t i = 0; i < header.modules; ++i) {
+            expected += std::uint64_t(modules[i].nodes) * sizeof(Node) + std::uint64_t(modules[i].lists) * sizeof(std::uint32_t) +
+               std::uint64_t(modules[i].strings) * sizeof(Span);
+         }
+
+         if (expected != size) {
+            invalid();
+         }
+
+         auto symbols = reinterpret_cast<const Span*>(modules + header.modules);
+         auto at = reinterpret_cast<const char*>(symbols + header.symbols);
+         bytes = data + size - header.bytes;
+
+         interned.reserve(header.symbols);
+         for (std::uint32_t i = 0; i < header.symbols; ++i) {
+            interned.push_back(symbol::intern(get_bytes(symbols[i])));
+         }
+
+         std::shared_ptr<Ast> main;
+         for (std::uint32_t i = 0; i < header.modules; ++i) {
+            auto program = read_module(modules[i], at);
+
+            if (modules[i].name.offset == none) {
+               main = program;
+            } else {
+               imports.emplace_back(std::string(get_bytes(modules[i].name)), program);
+            }
+         }
+
+         if (!main) {
+            invalid();
+         }
+         return main;
+      }
+   };
+}
+
+// Helper functions
+
+static std::string read_source(const std::string& code) {
+   std::ifstream file (code);
+   return (file.is_open() ? std::string{std::istreambuf_iterator<char>{file}, {}} : code);
+}
+
+// Every import node lives in the arena, so the imports of a module are found with a linear scan
+
+static void find_imports(const Ast& program, std::vector<std::string>& found) {
+   for (auto& node : program.nodes) {
+      if (node.type == StmtType::import && program[node.a].type == StmtType::string) {
+         found.push_back(program.strings[program[node.a].a]);
+      }
+   }
+}
+
+// Functions
+
+namespace image {
+   bool is_image(const std::string& path) {
+      std::ifstream file (path, std::ios::binary);
+      char header[4] {};
+      return file.read(header, 4) && std::memcmp(header, magic, 4) == 0;
+   }
+
+   // Parses every module imported through a string literal, following imports of imports. Image
+   // files are left to be loaded when the import runs.
+
+   Imports collect_imports(const Ast& program) {
+      Imports imports;
+      std::unordered_set<std::string> seen;
+      std::vector<std::string> pending;
+      find_imports(program, pending);
+
+      while (!pending.empty()) {
+         auto name = std::move(pending.back());
+         pending.pop_back();
+
+         if (!seen.insert(name).second || is_image(name)) {
+            continue;
+         }
+
+         auto source = read_source(name);
+         Lexer lexer (source);
+         auto& tokens = lexer.lex();
+
+         Parser parser (tokens, source);
+         auto module = parser.parse();
+         find_imports(*module, pending);
+         imports.emplace_back(name, std::move(module));
+      }
+      return imports;
+   }
+
+   void write(const std::string& path, const Ast& program, const Imports& imports) {
+      Writer writer;
+      writer.add_module("", program);
+
+      for (auto& [name, module] : imports) {
+         writer.add_module(name, *module);
+      }
+      writer.write(path);
+   }
+
+   std::shared_ptr<Ast> load(const std::string& path, Imports& imports) {
+      std::ifstream file (path, std::ios::binary | std::ios::ate);
+      auto size = (file.is_open() ? std::streamoff(file.tellg()) : -1);
+
+      if (size < 0) {
+         error::fail("Could not open program image '" + path + "'.");
+      }
+
+      // The reader copies every arena out of the image and fixes up its nodes, so the image is
+      // read in one go rather than mapped
+
+      auto data = std::make_unique_for_overwrite<char[]>(size);
+      if (!file.seekg(0) || !file.read(data.get(), size)) {
+         error::fail("Invalid program image '" + path + "'.");
+      }
+
+      Reader reader (path);
+      return reader.read(data.get(), size, imports);
+   }
+}
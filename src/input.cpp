@@ -0,0 +1,197 @@
+#include "input.hpp"
+
+// Includes
+
+#include <cerrno>
+#include <climits>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <termios.h>
+#include <unistd.h>
+
+// Buffer
+
+namespace {
+   constexpr std::size_t buffer_size = 1 << 16;
+
+   thread_local char buffer[buffer_size];
+   thread_local char* begin = buffer;
+   thread_local char* end = buffer;
+   thread_local std::string provided;
+   thread_local bool from_string = false;
+
+   bool fill() {
+      if (from_string) {
+         begin = end;
+         return false;
+      }
+
+      for (;;) {
+         auto result = ::read(STDIN_FILENO, buffer, buffer_size);
+         if (result < 0 && errno == EINTR) {
+            continue;
+         }
+
+         begin = buffer;
+         end = buffer + (result > 0 ? result : 0);
+         return result > 0;
+      }
+   }
+
+   inline int peek() {
+      if (begin == end && !fill()) {
+         return EOF;
+      }
+      return static_cast<unsigned char>(*begin);
+   }
+
+   inline bool is_space(int ch) {
+      return ch == ' ' || (ch >= '\t' && ch <= '\r');
+   }
+
+   void skip_spaces() {
+      while (is_space(peek())) {
+         ++begin;
+      }
+   }
+
+   void skip_line() {
+      for (int ch; (ch = peek()) != EOF;) {
+         ++begin;
+         if (ch == '\n') {
+            return;
+         }
+      }
+   }
+}
+
+// Terminal
+
+namespace {
+   termios original;
+   bool raw = false, saved = false;
+
+   void leave_raw() {
+      if (raw) {
+         tcsetattr(STDIN_FILENO, TCSANOW, &original);
+         raw = false;
+      }
+   }
+
+   // A signal that ends the process while the terminal is raw restores it first and then takes its
+   // default action, so the shell is not left without echo
+
+   void restore_and_raise(int signal) {
+      tcsetattr(STDIN_FILENO, TCSANOW, &original);
+      std::signal(signal, SIG_DFL);
+      std::raise(signal);
+   }
+
+   void restore_on_signals() {
+      for (auto signal : {SIGINT, SIGTERM, SIGHUP, SIGQUIT, SIGABRT, SIGSEGV}) {
+         struct sigaction action {}, previous {};
+         sigaction(signal, nullptr, &previous);
+         if (previous.sa_handler != SIG_DFL || (previous.sa_flags & SA_SIGINFO)) {
+            continue;
+         }
+
+         action.sa_handler = restore_and_raise;
+         sigemptyset(&action.sa_mask);
+         sigaction(signal, &action, nullptr);
+      }
+   }
+
+   void enter_raw() {
+      if (raw) {
+         return;
+      }
+
+      if (!saved) {
+         static bool terminal = isatty(STDIN_FILENO);
+         if (!terminal || tcgetattr(STDIN_FILENO, &original) != 0) {
+            return;
+         }
+         saved = true;
+         std::atexit(leave_raw);
+         restore_on_signals();
+      }
+
+      auto settings = original;
+      settings.c_lflag &= ~(ICANON | ECHO);
+      raw = (tcsetattr(STDIN_FILENO, TCSANOW, &settings) == 0);
+   }
+}
+
+// Functions
+
+namespace input {
+   void provide(std::string text) {
+      provided = std::move(text);
+      from_string = true;
+      begin = provided.data();
+      end = begin + provided.size();
+   }
+
+   // Mirrors 'std::cin >> num' followed by ignoring the rest of the line: leading whitespace is
+   // skipped, a failed read gives 0 and an out of range one saturates to the limits of 'int'
+
+   int read_number() {
+      leave_raw();
+      skip_spaces();
+
+      int ch = peek();
+      if (ch == EOF) {
+         return 0;
+      }
+
+      bool negative = (ch == '-');
+      if (ch == '-' || ch == '+') {
+         ++begin;
+      }
+
+      long value = 0;
+      bool digits = false;
+      while ((ch = peek()) >= '0' && ch <= '9') {
+         value = (value > INT_MAX ? value : value * 10 + (ch - '0'));
+         digits = true;
+         ++begin;
+      }
+      skip_line();
+
+      if (!digits) {
+         return 0;
+      }
+
+      value = (negative ? -value : value);
+      return (value > INT_MAX ? INT_MAX : (value < INT_MIN ? INT_MIN : value));
+   }
+
+   // Mirrors 'std::getline(std::cin >> std::ws, line)', returns false when nothing was read
+
+   bool read_line(std::string& line) {
+      leave_raw();
+      skip_spaces();
+      line.clear();
+
+      while (peek() != EOF) {
+         auto newline = static_cast<char*>(std::memchr(begin, '\n', end - begin));
+         if (newline) {
+            line.append(begin, newline);
+            begin = newline + 1;
+            return true;
+         }
+         line.append(begin, end);
+         begin = end;
+      }
+      return !line.empty();
+   }
+
+   int read_key() {
+      if (begin == end && !from_string) {
+         enter_raw();
+      }
+      return peek() == EOF ? EOF : *begin++;
+   }
+}
@@ -2,517 +2,462 @@
 
 // Includes
 
-#include "lexer.hpp"
-#include "parser.hpp"
-#include "stack.hpp"
-#include <cmath>
-#include <fstream>
-#include <termios.h>
-#include <unistd.h>
+#include "commands.hpp"
+#include "errors.hpp"
+#include <optional>
+#include <utility>
+
+// Interpreter
+
+Interpreter::Interpreter(bool fuse, bool import_once, bool jit)
+   : jit(jit), importer(fuse, import_once) {}
 
 // Evaluation functions
 
-Value Interpreter::evaluate(Program& program, Environment& env) {
-   Value last;
-   int id =++ fn_counter;
+Value Interpreter::evaluate(const Ast& program, Environment& env) {
+   return run(program, env).value;
+}
+
+Value Interpreter::call(Environment& env, Value func, std::vector<Value>& args) {
+   auto base = arguments.size();
+   arguments.insert(arguments.end(), args.begin(), args.end());
+   return invoke(std::move(func), base, false).value;
+}
+
+void Interpreter::source(const std::string& path) {
+   importer.root(path);
+}
 
-   for (auto& ast : program.stmts) {
-      last = evaluate_stmt(env, ast);
+void Interpreter::profile(Profiler* profiler) {
+   this->profiler = profiler;
+}
 
-      if (!return_stack.empty() && return_stack.top() >= id) {
-         while (!return_stack.empty() && return_stack.top() != id) {
-            return_stack.pop();
-         }
-         return last;
+// Runs the root block of a program, an abrupt completion is left to the caller so that an
+// imported module can break out of the importing loop
+
+Result Interpreter::run(const Ast& program, Environment& env) {
+   auto saved = ast;
+   enter(&program);
+   auto result = evaluate_block(env, program[program.root]);
+   enter(saved);
+   return result;
+}
+
+// Switches to another program together with its call site caches and hot loops
+
+void Interpreter::enter(const Ast* program) {
+   if (program == ast) {
+      return;
+   }
+   ast = program;
+
+   if (program) {
+      sites = &call_sites[program];
+      if (sites->size() < program->call_sites) {
+         sites->resize(program->call_sites);
+      }
+   }
+
+   if (program && jit) {
+      hot = &hot_loops[program];
+      if (hot->owner.expired()) {
+         hot->owner = program->weak_from_this();
+         hot->loops.clear();
       }
+   }
+}
 
-      if (should_break || should_continue) {
-         return last;
+Result Interpreter::evaluate_block(Environment& env, const Node& block) {
+   Result last;
+   for (auto stmt : ast->list(block.c)) {
+      last = evaluate_stmt(env, at(stmt));
+      if (last.abrupt()) {
+         break;
       }
    }
    return last;
 }
 
-Value Interpreter::call(Environment& env, Value func, std::vector<Value>& args) {
-   if (func->type != ValueType::fn) {
-      std::cerr << "Only functions are callable.\n";
-      std::exit(1);
+// Finishes an iteration that compiled code handed back at statement 'from' of the loop body
+
+Result Interpreter::resume_loop(Environment& env, const Node& body, std::uint32_t from) {
+   if (body.type != StmtType::program) {
+      return evaluate_stmt(env, body);
    }
 
-   auto& fn = static_cast<Fn&>(*func.get());
-   if (args.size() != fn.params.size()) {
-      std::cerr << "Function parameter count does not match call expression argument count.\n";
-      std::exit(1);
+   Result last;
+   auto stmts = ast->list(body.c);
+   for (auto stmt = stmts.begin() + from; stmt != stmts.end(); ++stmt) {
+      last = evaluate_stmt(env, at(*stmt));
    }
-   fn_stack.push(1);
-   Environment new_env (fn.env);
+   return last;
+}
+
+// Runs a function with its arguments on top of 'arguments' from 'base' on, 'checked' skips the
+// type and arity checks for callees that come from a call site cache. A call in tail position
+// does not recurse, it leaves its callee in 'tail' and its arguments at 'base', and the loop
+// below runs it in the same frame once the current body has returned.
+
+Result Interpreter::invoke(Value func, std::size_t base, bool checked) {
+   Environment new_env (nullptr, nullptr);
+   auto saved = ast;
+
+   for (;;) {
+      if (!checked && func.type != ValueType::fn) {
+         error::fail("Only functions are callable.");
+      }
+
+      auto& fn = func.as<Fn>();
+      if (!checked && arguments.size() - base != fn.params.size()) {
+         error::fail("Function parameter count does not match call expression argument count.");
+      }
+      new_env.reset(fn.env, fn.scope.get());
+
+      for (std::size_t i = 0; i < fn.params.size(); ++i) {
+         new_env.set_slot(i, std::move(arguments[base + i]));
+      }
+      arguments.resize(base);
+
+      enter(fn.ast.get());
+      auto& body = at(fn.body);
+      Result result;
+      {
+         Profiler::Call call (profiler, body, fn.identifier);
+         result = (body.type == StmtType::program ? evaluate_block(new_env, body) : evaluate_stmt(new_env, body));
+      }
 
-   for (int i = 0; i < args.size(); ++i) {
-      new_env.set(fn.params[i], args[i]);
+      if (!tail.pending) {
+         enter(saved);
+         return result;
+      }
+      tail.pending = false;
+      func = std::move(tail.func);
+      checked = false;
    }
-   auto result = evaluate(static_cast<Program&>(*fn.body.get()), new_env);
-   fn_stack.pop();
-   return result;
 }
 
 // Statement evaluation functions
 
-Value Interpreter::evaluate_stmt(Environment& env, Stmt stmt) {
-   switch (stmt->type) {
+Result Interpreter::evaluate_stmt(Environment& env, const Node& node) {
+   error::check_stack("Recursion limit exceeded.");
+   if (profiler) [[unlikely]] {
+      return evaluate_profiled(env, node);
+   }
+   return dispatch_stmt(env, node);
+}
+
+Result Interpreter::evaluate_profiled(Environment& env, const Node& node) {
+   if (!profiler->tracing()) {
+      profiler->poll(*ast, node);
+      return dispatch_stmt(env, node);
+   }
+
+   Profiler::Statement timed (*profiler, *ast, node);
+   return dispatch_stmt(env, node);
+}
+
+Result Interpreter::dispatch_stmt(Environment& env, const Node& node) {
+   switch (node.type) {
    case StmtType::var_decl:
-      return evaluate_var_decl(env, stmt);
+      return evaluate_var_decl(env, node);
    case StmtType::fn_decl:
-      return evaluate_fn_decl(env, stmt);
+      return evaluate_fn_decl(env, node);
    case StmtType::while_loop:
-      return evaluate_while_loop(env, stmt);
+      return evaluate_while_loop(env, node);
    case StmtType::break_stmt:
-      return evaluate_break(env, stmt);
+      return evaluate_break(env, node);
    case StmtType::continue_stmt:
-      return evaluate_continue(env, stmt);
+      return evaluate_continue(env, node);
    case StmtType::push:
-      return evaluate_push(env, stmt);
+      return evaluate_push(env, node);
    case StmtType::type:
-      return evaluate_type(env, stmt);
+      return evaluate_type(env, node);
    case StmtType::pull:
-      return evaluate_pull(env, stmt);
+      return evaluate_pull(env, node);
    case StmtType::import:
-      return evaluate_import(env, stmt);
+      return evaluate_import(env, node);
    default:
-      return evaluate_expr(env, stmt);
+      return evaluate_expr(env, node);
    }
 }
 
-Value Interpreter::evaluate_var_decl(Environment& env, Stmt stmt) {
-   auto& decl = static_cast<VarDecl&>(*stmt.get());
-   auto value = evaluate_stmt(env, decl.value);
+Result Interpreter::evaluate_var_decl(Environment& env, const Node& node) {
+   auto value = evaluate_stmt(env, at(node.b));
+   if (value.abrupt()) {
+      return value;
+   }
 
-   if (decl.identifier->type != StmtType::identifier) {
-      std::cerr << "Expected identifier in variable declaration.\n";
-      std::exit(1);
+   auto& ident = at(node.a);
+   if (ident.type != StmtType::identifier) {
+      error::fail("Expected identifier in variable declaration.");
+   }
+
+   if (ident.slot() != -1) {
+      env.set_slot(ident.slot(), value.value);
+   } else {
+      env.set(ident.a, value.value);
    }
-   env.set(static_cast<IdentLiteral&>(*decl.identifier.get()).identifier, value);
    return value;
 }
 
-Value Interpreter::evaluate_fn_decl(Environment& env, Stmt stmt) {
-   auto& decl = static_cast<FnDecl&>(*stmt.get());
-   std::vector<std::string> params;
+Result Interpreter::evaluate_fn_decl(Environment& env, const Node& node) {
+   std::vector<Symbol> params;
 
-   for (auto& param : decl.args) {
-      if (param->type != StmtType::identifier) {
-         std::cerr << "Expected identifier in function declaration parameter list.\n";
-         std::exit(1);
+   for (auto param : ast->list(node.c)) {
+      if (at(param).type != StmtType::identifier) {
+         error::fail("Expected identifier in function declaration parameter list.");
       }
-      params.push_back(static_cast<IdentLiteral&>(*param.get()).identifier);
+      params.push_back(at(param).a);
    }
 
-   if (decl.identifier->type != StmtType::identifier) {
-      std::cerr << "Expected identifier in function declaration.\n";
-      std::exit(1);
+   auto& ident = at(node.a);
+   if (ident.type != StmtType::identifier) {
+      error::fail("Expected identifier in function declaration.");
    }
 
-   auto identifier = static_cast<IdentLiteral&>(*decl.identifier.get()).identifier;
-   auto fn = Fn::make(identifier, params, &env, decl.body);
-   env.set(identifier, fn);
+   auto fn = Fn::make(ident.a, params, ast->scopes[node.d], &env, ast->shared_from_this(), node.b);
+   if (ident.slot() != -1) {
+      env.set_slot(ident.slot(), fn);
+   } else {
+      env.set(ident.a, fn);
+   }
    return fn;
 }
 
-Value Interpreter::evaluate_while_loop(Environment& env, Stmt stmt) {
-   auto& whl = static_cast<WhileLoop&>(*stmt.get());
-   Value result = Null::make();
-   loop_stack.push(1);
+Result Interpreter::evaluate_while_loop(Environment& env, const Node& node) {
+   auto& body = at(node.a);
+   Result result = Null::make();
+   ++loops;
+
+   // A block body that declares names gets one environment that is cleared between iterations
+
+   auto reuse = (body.type == StmtType::program && body.d != no_node);
+   std::optional<Environment> scope;
+   if (reuse) {
+      scope.emplace(&env);
+   }
+   auto loop = (jit && !reuse && !profiler ? &hot->loops[ast->id(node)] : nullptr);
 
    while (true) {
-      if (stack::empty() || !stack::pop()) {
-         loop_stack.pop();
-         return result;
+      if (loop && loop->code) {
+         jit::Frame frame {stack::buffer.data, stack::buffer.top, stack::buffer.end, reg::file.dense, reg::file.size, 0, 0};
+         auto status = loop->code->run(frame);
+         stack::buffer.top = frame.top;
+
+         if (frame.ran) {
+            result = NumberValue::make(frame.result);
+         }
+         if (status == 0) {
+            break;
+         }
+         result = resume_loop(env, body, status - 1);
+         continue;
       }
-      result = evaluate_stmt(env, whl.body);
 
-      if (should_break) {
-         should_break = false;
-         loop_stack.pop();
-         return result;
+      if (loop && !loop->tried && ++loop->iterations >= jit::threshold) {
+         loop->tried = true;
+         loop->code = jit::Loop::compile(*ast, node);
       }
 
-      if (should_continue) {
-         should_continue = false;
+      if (stack::empty() || !stack::pop()) {
+         break;
+      }
+      if (reuse) {
+         scope->reset(&env, ast->scope(body.d));
+         result = evaluate_block(*scope, body);
+      } else {
+         result = evaluate_stmt(env, body);
       }
-   }
-}
 
-Value Interpreter::evaluate_break(Environment& env, Stmt stmt) {
-   if (loop_stack.empty()) {
-      std::cerr << "'BreakStmt' outside of a loop.\n";
-      std::exit(1);
+      if (result.completion == Completion::break_loop) {
+         break;
+      }
    }
-   should_break = true;
-   return Null::make();
+   --loops;
+   return result.value;
 }
 
-Value Interpreter::evaluate_continue(Environment& env, Stmt stmt) {
-   if (loop_stack.empty()) {
-      std::cerr << "'ContinueStmt' outside of a loop.\n";
-      std::exit(1);
+Result Interpreter::evaluate_break(Environment& env, const Node& node) {
+   if (loops == 0) {
+      error::fail("'BreakStmt' outside of a loop.");
    }
-   should_continue = true;
-   return Null::make();
+   return {Null::make(), Completion::break_loop};
 }
 
-// Helper function
-
-void push_to_stack(Value value) {
-   if (value->type == ValueType::number) {
-      stack::push(value->as_number());
-   } else if (value->type == ValueType::array) {
-      auto& array = static_cast<Array&>(*value.get());
-      for (auto& element : array.array) {
-         push_to_stack(element);
-      }
-   } else if (value->type != ValueType::null) {
-      auto string = value->as_string();
-      for (int i = string.size() - 1; i >= 0; --i) {
-         stack::push(string[i]);
-      }
-   } else {
-      std::cerr << "Invalid value to push to stack.\n";
-      std::exit(1);
+Result Interpreter::evaluate_continue(Environment& env, const Node& node) {
+   if (loops == 0) {
+      error::fail("'ContinueStmt' outside of a loop.");
    }
+   return {Null::make(), Completion::continue_loop};
 }
 
-Value Interpreter::evaluate_push(Environment& env, Stmt stmt) {
-   auto& psh = static_cast<PushStmt&>(*stmt.get());
-   auto value = evaluate_stmt(env, psh.stmt);
-   push_to_stack(value);
+Result Interpreter::evaluate_push(Environment& env, const Node& node) {
+   auto value = evaluate_stmt(env, at(node.a));
+   if (!value.abrupt()) {
+      command::push_to_stack(value.value);
+   }
    return value;
 }
 
-Value Interpreter::evaluate_type(Environment& env, Stmt stmt) {
-   auto& typ = static_cast<TypeStmt&>(*stmt.get());
-   auto value = evaluate_stmt(env, typ.stmt);
-   auto result = long(value->type);
+Result Interpreter::evaluate_type(Environment& env, const Node& node) {
+   auto value = evaluate_stmt(env, at(node.a));
+   if (value.abrupt()) {
+      return value;
+   }
+   auto result = long(value.value.type);
 
    stack::push(result);
    return NumberValue::make(result);
 }
 
-Value Interpreter::evaluate_pull(Environment& env, Stmt stmt) {
+Result Interpreter::evaluate_pull(Environment& env, const Node& node) {
    if (stack::empty()) {
-      std::cerr << "'#': Expected stack to not be empty.\n";
-      std::exit(1);
+      error::fail("'#': Expected stack to not be empty.");
    }
    return NumberValue::make(stack::pop());
 }
 
-Value Interpreter::evaluate_import(Environment& env, Stmt stmt) {
-   auto& imp = static_cast<ImportStmt&>(*stmt.get());
-   auto code = evaluate_stmt(env, imp.import)->as_string();
-   std::ifstream file (code);
-   code = (file.is_open() ? std::string{std::istreambuf_iterator<char>{file}, {}} : code);
-   file.close();
-   
-   Lexer lexer (code);
-   auto& tokens = lexer.lex();
+Result Interpreter::evaluate_import(Environment& env, const Node& node) {
+   auto name = evaluate_stmt(env, at(node.a));
+   if (name.abrupt()) {
+      return name;
+   }
 
-   Parser parser (tokens);
-   auto& program = parser.parse();
+   auto module = importer.enter(name.value.as_string(), ast->bundle);
+   if (!module) {
+      return Null::make();
+   }
 
-   return evaluate(program, env);
+   auto result = run(*module->program, env);
+   importer.leave();
+   return result;
 }
 
 // Expression evaluation functions
 
-Value Interpreter::evaluate_expr(Environment& env, Stmt stmt) {
-   switch (stmt->type) {
+Result Interpreter::evaluate_expr(Environment& env, const Node& node) {
+   switch (node.type) {
    case StmtType::ternary:
-      return evaluate_ternary_expr(env, stmt);
+      return evaluate_ternary_expr(env, node);
    case StmtType::call:
-      return evaluate_call_expr(env, stmt);
+      return evaluate_call_expr(env, node);
    case StmtType::command:
-      return evaluate_command(env, stmt);
+      return evaluate_command(env, node);
+   case StmtType::fused:
+      return evaluate_fused_command(env, node);
    default:
-      return evaluate_primary_expr(env, stmt);
+      return evaluate_primary_expr(env, node);
    }
 }
 
-Value Interpreter::evaluate_ternary_expr(Environment& env, Stmt stmt) {
-   auto& ternary = static_cast<TernaryExpr&>(*stmt.get());
+Result Interpreter::evaluate_ternary_expr(Environment& env, const Node& node) {
    auto cond = (!stack::empty() && stack::pop());
-   return evaluate_stmt(env, (cond ? ternary.left : ternary.right));
+   return evaluate_stmt(env, at(cond ? node.a : node.b));
 }
 
-Value Interpreter::evaluate_call_expr(Environment& env, Stmt stmt) {
-   auto& call = static_cast<CallExpr&>(*stmt.get());
-   std::vector<Value> args;
-   for (auto& arg : call.args) {
-      args.push_back(evaluate_stmt(env, arg));
+Result Interpreter::evaluate_call_expr(Environment& env, const Node& node) {
+   auto base = arguments.size();
+   for (auto arg : ast->list(node.c)) {
+      auto value = evaluate_stmt(env, at(arg));
+      if (value.abrupt()) {
+         arguments.resize(base);
+         return value;
+      }
+      arguments.push_back(std::move(value.value));
    }
 
-   if (call.identifier->type != StmtType::identifier) {
-      return this->call(env, evaluate_call_expr(env, call.identifier), args);
-   } else {
-      return this->call(env, env.get(static_cast<IdentLiteral&>(*call.identifier.get()).identifier), args);
-   }
-}
+   auto& callee = at(node.a);
+   Value func;
+   bool checked = false;
 
-Value Interpreter::evaluate_command(Environment& env, Stmt stmt) {
-   auto& command = static_cast<Command&>(*stmt.get());
-   Value final = Null::make();
-   auto times = (command.right.has_value() ? evaluate_stmt(env, command.right.value())->as_number() : 1);
-
-   for (int i = 0; i < times; ++i) {
-      switch (command.op) {
-      case Type::tilde: {
-         int num = 0;
-         std::cin >> num;
-         std::cin.clear();
-         std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
-         stack::push(num);
-         final = NumberValue::make(num);
-         break;
-      }
-      case Type::grave: {
-         termios oldt, newt;
-         tcgetattr(STDIN_FILENO, &oldt);
-         newt = oldt;
-         newt.c_lflag &= ~(ICANON | ECHO);
-         tcsetattr(STDIN_FILENO, TCSANOW, &newt);
-         char ch = getchar();
-         tcsetattr(STDIN_FILENO, TCSANOW, &oldt);
-         stack::push(ch);
-         final = NumberValue::make(ch);
-         break;
-      }
-      case Type::exclamation:
-         if (stack::empty()) {
-            std::cerr << "'!': Expected stack to not be empty.\n";
-            std::exit(1);
-         }
-         stack::push(!stack::pop());
-         final = NumberValue::make(stack::top());
-         break;
-      case Type::at:
-         std::exit(0);
-      case Type::dollar:
-         final = NumberValue::make(stack::pop());
-         break;
-      case Type::percent: {
-         if (stack::size() < 2) {
-            std::cerr << "'%': Expected stack to have at least 2 values.\n";
-            std::exit(1);
-         }
-         long a = stack::pop(), b = stack::pop();
-         if (a == 0) {
-            std::cerr << "Division by zero error.\n";
-            std::exit(1);
-         }
-         long result = b % a;
-         stack::push(result);
-         final = NumberValue::make(result);
-         break;
-      }
-      case Type::caret: {
-         if (stack::empty()) {
-            std::cerr << "'^': Expected stack to not be empty.\n";
-            std::exit(1);
-         }
-         long result = std::sqrt(stack::pop());
-         stack::push(result);
-         final = NumberValue::make(result);
-         break;
-      }
-      case Type::ampersand: {
-         std::string string;
-         std::getline(std::cin >> std::ws, string);
-         for (int i = string.size() - 1; i >= 0; --i) {
-            stack::push(string[i]);
-         }
-         final = StringValue::make(string);
-         break;
-      }
-      case Type::asterisk: {
-         if (stack::size() < 2) {
-            std::cerr << "'*': Expected stack to have at least 2 values.\n";
-            std::exit(1);
-         }
-         long result = stack::pop() * stack::pop();
-         stack::push(result);
-         final = NumberValue::make(result);
-         break;
-      }
-      case Type::hyphen: {
-         if (stack::size() < 2) {
-            std::cerr << "'-': Expected stack to have at least 2 values.\n";
-            std::exit(1);
-         }
-         long a = stack::pop(), b = stack::pop();
-         long result = b - a;
-         stack::push(result);
-         final = NumberValue::make(result);
-         break;
-      }
-      case Type::plus: {
-         if (stack::size() < 2) {
-            std::cerr << "'+': Expected stack to have at least 2 values.\n";
-            std::exit(1);
-         }
-         long result = stack::pop() + stack::pop();
-         stack::push(result);
-         final = NumberValue::make(result);
-         break;
-      }
-      case Type::equal: {
-         if (stack::size() < 2) {
-            std::cerr << "'=': Expected stack to have at least 2 values.\n";
-            std::exit(1);
-         }
-         bool result = stack::pop() == stack::pop();
-         stack::push(result);
-         final = NumberValue::make(result);
-         break;
-      }
-      case Type::backslash: {
-         long a = stack::pop(), b = stack::pop();
-         stack::push(a);
-         stack::push(b);
-         final = NumberValue::make(stack::top());
-         break;
-      }
-      case Type::colon:
-         stack::push(stack::top());
-         final = NumberValue::make(stack::top());
-         break;
-      case Type::apostrophe: {
-         if (stack::empty()) {
-            std::cerr << "''': Expected stack to not be empty.\n";
-            std::exit(1);
-         }
-         stack::push(-stack::pop());
-         final = NumberValue::make(stack::top());
-         break;
-      }
-      case Type::comma:
-         if (stack::empty()) {
-            std::cerr << "',': Expected stack to not be empty.\n";
-            std::exit(1);
-         }
-         std::cout << char(stack::pop());
-         break;
-      case Type::less: {
-         if (stack::size() < 2) {
-            std::cerr << "'<': Expected stack to have at least 2 values.\n";
-            std::exit(1);
-         }
-         long result = stack::pop() > stack::pop();
-         stack::push(result);
-         final = NumberValue::make(result);
-         break;
-      }
-      case Type::greater: {
-         if (stack::size() < 2) {
-            std::cerr << "'>': Expected stack to have at least 2 values.\n";
-            std::exit(1);
-         }
-         long result = stack::pop() < stack::pop();
-         stack::push(result);
-         final = NumberValue::make(result);
-         break;
-      }
-      case Type::period:
-         if (stack::empty()) {
-            std::cerr << "'.': Expected stack to not be empty.\n";
-            std::exit(1);
-         }
-         std::cout << stack::pop();
-         break;
-      case Type::slash: {
-         if (stack::size() < 2) {
-            std::cerr << "'/': Expected stack to have at least 2 values.\n";
-            std::exit(1);
-         }
-         long a = stack::pop(), b = stack::pop();
-         if (a == 0) {
-            std::cerr << "Division by zero error.\n";
-            std::exit(1);
-         }
-         long result = b / a;
-         stack::push(result);
-         final = NumberValue::make(result);
-         break;
-      }
-      case Type::size: {
-         long size = stack::size();
-         stack::push(size);
-         final = NumberValue::make(size);
-         break;
-      }
-      case Type::set_reg: {
-         long value = (stack::empty() ? 0 : stack::pop());
-         if (!stack::empty()) {
-            reg::set(stack::pop(), value);
-         }
-         final = NumberValue::make(value);
-         break;
-      }
-      case Type::get_reg: {
-         long value = 0;
-         if (!stack::empty()) {
-            value = reg::get(stack::pop());
-         }
-         stack::push(value);
-         final = NumberValue::make(value);
-         break;
-      }
-      case Type::lor: {
-         if (stack::size() < 2) {
-            std::cerr << "'||': Expected stack to have at least 2 values.\n";
-            std::exit(1);
-         }
-         long result = stack::pop() || stack::pop();
-         stack::push(result);
-         final = NumberValue::make(result);
-         break;
+   if (callee.type != StmtType::identifier) {
+      auto result = evaluate_call_expr(env, callee);
+      if (result.abrupt()) {
+         arguments.resize(base);
+         return result;
       }
-      case Type::land: {
-         if (stack::size() < 2) {
-            std::cerr << "'&&': Expected stack to have at least 2 values.\n";
-            std::exit(1);
+      func = std::move(result.value);
+   } else if (callee.slot() == -1 || node.d == no_node) {
+      func = evaluate_primary_expr(env, callee).value;
+   } else {
+      auto owner = env.ancestor(callee.depth());
+      auto& site = (*sites)[node.d];
+
+      if (site.owner == owner && site.version == owner->version()) {
+         func = site.fn;
+         checked = true;
+      } else {
+         func = evaluate_primary_expr(env, callee).value;
+         if (owner->defines(callee.slot()) && func.type == ValueType::fn && func.as<Fn>().params.size() == arguments.size() - base) {
+            site = {owner, owner->version(), func};
          }
-         long result = stack::pop() && stack::pop();
-         stack::push(result);
-         final = NumberValue::make(result);
-         break;
       }
-      default:
-         std::cerr << "Unknown command '" << int(command.op) << "'.\n";
-         std::exit(1);
-         break;
+   }
+
+   if (node.op == tail_call) {
+      tail = {std::move(func), true};
+      return Null::make();
+   }
+   return invoke(std::move(func), base, checked);
+}
+
+Result Interpreter::evaluate_command(Environment& env, const Node& node) {
+   if (node.a == no_node) {
+      if (profiler) [[unlikely]] {
+         profiler->command(Type(node.op));
       }
+      return command::execute(Type(node.op));
    }
-   return final;
+
+   auto count = evaluate_stmt(env, at(node.a));
+   if (count.abrupt()) {
+      return count;
+   }
+
+   auto times = count.value.as_number();
+   if (profiler) [[unlikely]] {
+      profiler->command(Type(node.op), times);
+   }
+   return command::repeat(Type(node.op), times);
 }
 
-Value Interpreter::evaluate_primary_expr(Environment& env, Stmt stmt) {
-   switch (stmt->type) {
+Result Interpreter::evaluate_fused_command(Environment& env, const Node& node) {
+   if (profiler) [[unlikely]] {
+      profiler->command(Fusion(node.op));
+   }
+   return command::execute(Fusion(node.op), node.number());
+}
+
+Result Interpreter::evaluate_primary_expr(Environment& env, const Node& node) {
+   switch (node.type) {
    case StmtType::identifier:
-      return env.get(static_cast<IdentLiteral&>(*stmt.get()).identifier);
+      if (node.slot() != -1) {
+         return env.get(node.depth(), node.slot(), node.a);
+      }
+      return env.get(node.a);
    case StmtType::number:
-      return NumberValue::make(static_cast<NumberLiteral&>(*stmt.get()).number);
+      return NumberValue::make(node.number());
    case StmtType::string:
-      return StringValue::make(static_cast<StringLiteral&>(*stmt.get()).string);
+      return StringValue::make(ast->strings[node.a]);
    case StmtType::array: {
       std::vector<Value> array;
-      for (const auto& element : static_cast<ArrayLiteral&>(*stmt.get()).stmts) {
-         array.push_back(evaluate_stmt(env, element));
+      for (auto element : ast->list(node.c)) {
+         auto value = evaluate_stmt(env, at(element));
+         if (value.abrupt()) {
+            return value;
+         }
+         array.push_back(std::move(value.value));
       }
       return Array::make(array);
    }
    case StmtType::program: {
-      Environment new_env (&env);
-      return evaluate(static_cast<Program&>(*stmt.get()), new_env);
+      if (node.d == no_node) {
+         return evaluate_block(env, node);
+      }
+      Environment new_env (&env, ast->scope(node.d));
+      return evaluate_block(new_env, node);
    }
    default:
-      std::cerr << "Unexpected expression while evaluating.\n";
-      std::exit(1);
+      error::fail("Unexpected expression while evaluating.");
    }
 }
@@ -0,0 +1,588 @@
+#include "jit.hpp"
+
+// Includes
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#if defined(__x86_64__)
+#include <sys/mman.h>
+#endif
+
+// Stack effects
+//
+// How deep the stack has to be for a statement to take its fast path, and how much it changes
+// the height. Returns false for statements the compiler does not handle.
+
+namespace {
+   struct Effect {
+      int need, delta;
+   };
+
+   bool effect(const Ast& ast, const Node& node, Effect& effect) {
+      switch (node.type) {
+      case StmtType::push:
+         effect = {0, 1};
+         return ast[node.a].type == StmtType::number;
+      case StmtType::fused:
+         switch (Fusion(node.op)) {
+         case Fusion::dup_multiply:
+            effect = {1, 0};
+            return true;
+         case Fusion::swap_subtract:
+         case Fusion::equal_not:
+            effect = {2, -1};
+            return true;
+         case Fusion::push_divide:
+         case Fusion::push_modulo:
+            effect = {1, 0};
+            return node.number() != 0;
+         default:
+            effect = {1, 0};
+            return true;
+         }
+      case StmtType::command:
+         if (node.a != no_node) {
+            return false;
+         }
+
+         switch (Type(node.op)) {
+         case Type::plus: case Type::hyphen: case Type::asterisk: case Type::slash: case Type::percent:
+         case Type::equal: case Type::less: case Type::greater:
+            effect = {2, -1};
+            return true;
+         case Type::exclamation: case Type::apostrophe: case Type::get_reg:
+            effect = {1, 0};
+            return true;
+         case Type::colon:
+            effect = {1, 1};
+            return true;
+         case Type::dollar:
+            effect = {1, -1};
+            return true;
+         case Type::backslash:
+            effect = {2, 0};
+            return true;
+         case Type::size:
+            effect = {0, 1};
+            return true;
+         case Type::set_reg:
+            effect = {2, -2};
+            return true;
+         default:
+            return false;
+         }
+      default:
+         return false;
+      }
+   }
+}
+
+#if defined(__x86_64__)
+
+// Emitter
+//
+// Just the handful of instruction forms the compiler needs. Memory operands are always a base
+// register plus an 8 bit displacement, and no base is rsp or r12, so none of them needs a SIB
+// byte except the scaled register access, which is written out in full.
+
+namespace {
+   enum Reg : int {
+      rax, rcx, rdx, rbx, rsp, rbp, rsi, rdi, r8, r9, r10, r11, r12
+   };
+
+   enum Cond : std::uint8_t {
+      above_equal = 0x3, equal = 0x4, not_equal = 0x5, less = 0xc, greater = 0xf
+   };
+
+   // Frame field offsets
+
+   constexpr int frame_data = 0, frame_top = 8, frame_end = 16, frame_registers = 24;
+   constexpr int frame_count = 32, frame_result = 40, frame_ran = 48;
+
+   static_assert(offsetof(jit::Frame, ran) == frame_ran);
+
+   class Emitter {
+      struct Fixup {
+         std::size_t at;
+         std::uint32_t target;
+      };
+
+      std::vector<Fixup> fixups;
+
+      void byte(std::uint8_t value) {
+         code.push_back(value);
+      }
+
+      void word(std::uint32_t value) {
+         for (int i = 0; i < 4; ++i) {
+            byte(value >> (8 * i));
+         }
+      }
+
+      void rex(int reg, int rm) {
+         byte(0x48 | (reg >> 3) << 2 | (rm >> 3));
+      }
+
+      void memory(int reg, int base, int disp) {
+         byte(0x40 | (reg & 7) << 3 | (base & 7));
+         byte(std::uint8_t(disp));
+      }
+
+      void direct(int reg, int rm) {
+         byte(0xc0 | (reg & 7) << 3 | (rm & 7));
+      }
+
+   public:
+      std::vector<std::uint8_t> code;
+
+      // Labels are bail out stubs numbered by statement, 'done' and 'exit' come after them
+
+      static constexpr std::uint32_t done = 0xfffffffe, exit = 0xffffffff;
+
+      void load(int dst, int base, int disp) {
+         rex(dst, base);
+         byte(0x8b);
+         memory(dst, base, disp);
+      }
+
+      void store(int base, int disp, int src) {
+         rex(src, base);
+         byte(0x89);
+         memory(src, base, disp);
+      }
+
+      // 'op' is the load form of add (0x03), sub (0x2b) or cmp (0x3b)
+
+      void arith(std::uint8_t op, int dst, int base, int disp) {
+         rex(dst, base);
+         byte(op);
+         memory(dst, base, disp);
+      }
+
+      // 'op' is the store form of mov (0x89), add (0x01), sub (0x29), cmp (0x39) or test (0x85)
+
+      void arith(std::uint8_t op, int dst, int src) {
+         rex(src, dst);
+         byte(op);
+         direct(src, dst);
+      }
+
+      void imul(int dst, int base, int disp) {
+         rex(dst, base);
+         byte(0x0f);
+         byte(0xaf);
+         memory(dst, base, disp);
+      }
+
+      void imul(int dst, int src) {
+         rex(dst, src);
+         byte(0x0f);
+         byte(0xaf);
+         direct(dst, src);
+      }
+
+      // Group 1 with a 32 bit immediate, 'ext' is 0 for add, 5 for sub and 7 for cmp
+
+      void immediate(int ext, int reg, std::int32_t value) {
+         rex(0, reg);
+         byte(0x81);
+         direct(ext, reg);
+         word(value);
+      }
+
+      void move(int reg, long value) {
+         rex(0, reg);
+         byte(0xb8 | (reg & 7));
+         for (int i = 0; i < 8; ++i) {
+            byte(std::uint64_t(value) >> (8 * i));
+         }
+      }
+
+      // rax = 'cond' ? 1 : 0
+
+      void set(Cond cond) {
+         byte(0x0f);
+         byte(0x90 | cond);
+         byte(0xc0);
+         byte(0x0f);
+         byte(0xb6);
+         byte(0xc0);
+      }
+
+      // rdx:rax / rcx
+
+      void divide() {
+         byte(0x48);
+         byte(0x99);
+         byte(0x48);
+         byte(0xf7);
+         byte(0xf9);
+      }
+
+      void negate(int base, int disp) {
+         rex(0, base);
+         byte(0xf7);
+         memory(3, base, disp);
+      }
+
+      // rax <-> r10[rcx * 8]
+
+      void load_register() {
+         byte(0x49);
+         byte(0x8b);
+         byte(0x04);
+         byte(0xca);
+      }
+
+      void store_register() {
+         byte(0x49);
+         byte(0x89);
+         byte(0x04);
+         byte(0xca);
+      }
+
+      void jump(Cond cond, std::uint32_t target) {
+         byte(0x0f);
+         byte(0x80 | cond);
+         fixups.push_back({code.size(), target});
+         word(0);
+      }
+
+      void jump(std::uint32_t target) {
+         byte(0xe9);
+         fixups.push_back({code.size(), target});
+         word(0);
+      }
+
+      void jump_back(std::size_t target) {
+         byte(0xe9);
+         word(std::uint32_t(target - (code.size() + 4)));
+      }
+
+      void raw(std::initializer_list<std::uint8_t> bytes) {
+         code.insert(code.end(), bytes);
+      }
+
+      // Emits the bail out stubs and the shared exit, then resolves every jump
+
+      void finish(std::uint32_t stmts) {
+         std::vector<std::size_t> labels (stmts);
+         for (std::uint32_t k = 0; k < stmts; ++k) {
+            labels[k] = code.size();
+            byte(0xb8);
+            word(k + 1);
+            jump(exit);
+         }
+
+         auto done_at = code.size();
+         raw({0x31, 0xc0});
+
+         auto exit_at = code.size();
+         store(rdi, frame_top, rsi);
+         store(rdi, frame_result, rbx);
+         rex(r12, rdi);
+         byte(0x89);
+         memory(r12, rdi, frame_ran);
+         raw({0x41, 0x5c, 0x5b, 0xc3});
+
+         for (auto& fixup : fixups) {
+            auto target = (fixup.target == done ? done_at : fixup.target == exit ? exit_at : labels[fixup.target]);
+            std::uint32_t rel = target - (fixup.at + 4);
+            std::memcpy(&code[fixup.at], &rel, 4);
+         }
+      }
+   };
+
+   // Emits one statement, which leaves its result value in rax. 'k' is its index in the body.
+
+   void emit_stmt(Emitter& out, const Ast& ast, const Node& node, std::uint32_t k) {
+      auto binary = [&](std::uint8_t op) {
+         out.load(rax, rsi, -16);
+         out.arith(op, rax, rsi, -8);
+      };
+
+      auto compare = [&](Cond cond) {
+         out.load(rax, rsi, -16);
+         out.arith(0x3b, rax, rsi, -8);
+         out.set(cond);
+      };
+
+      auto pop_store = [&] {
+         out.immediate(5, rsi, 8);
+         out.store(rsi, -8, rax);
+      };
+
+      auto division = [&](bool remainder) {
+         out.load(rcx, rsi, -8);
+         out.arith(0x85, rcx, rcx);
+         out.jump(equal, k);
+         out.load(rax, rsi, -16);
+         out.divide();
+         if (remainder) {
+            out.arith(0x89, rax, rdx);
+         }
+         pop_store();
+      };
+
+      auto with_operand = [&](auto body) {
+         out.load(rax, rsi, -8);
+         out.move(rcx, node.number());
+         body();
+         out.store(rsi, -8, rax);
+      };
+
+      if (node.type == StmtType::push) {
+         out.move(rax, ast[node.a].number());
+         out.store(rsi, 0, rax);
+         out.immediate(0, rsi, 8);
+         return;
+      }
+
+      if (node.type == StmtType::fused) {
+         switch (Fusion(node.op)) {
+         case Fusion::dup_multiply:
+            out.load(rax, rsi, -8);
+            out.imul(rax, rax);
+            out.store(rsi, -8, rax);
+            return;
+         case Fusion::swap_subtract:
+            out.load(rax, rsi, -8);
+            out.arith(0x2b, rax, rsi, -16);
+            pop_store();
+            return;
+         case Fusion::equal_not:
+            compare(not_equal);
+            pop_store();
+            return;
+         case Fusion::push_add:
+            return with_operand([&] { out.arith(0x01, rax, rcx); });
+         case Fusion::push_subtract:
+            return with_operand([&] { out.arith(0x29, rax, rcx); });
+         case Fusion::push_multiply:
+            return with_operand([&] { out.imul(rax, rcx); });
+         case Fusion::push_divide:
+            return with_operand([&] { out.divide(); });
+         case Fusion::push_modulo:
+            return with_operand([&] { out.divide(); out.arith(0x89, rax, rdx); });
+         case Fusion::push_equal:
+            return with_operand([&] { out.arith(0x39, rax, rcx); out.set(equal); });
+         case Fusion::push_less:
+            return with_operand([&] { out.arith(0x39, rax, rcx); out.set(less); });
+         case Fusion::push_greater:
+            return with_operand([&] { out.arith(0x39, rax, rcx); out.set(greater); });
+         }
+      }
+
+      switch (Type(node.op)) {
+      case Type::plus:
+         binary(0x03);
+         pop_store();
+         break;
+      case Type::hyphen:
+         binary(0x2b);
+         pop_store();
+         break;
+      case Type::asterisk:
+         out.load(rax, rsi, -16);
+         out.imul(rax, rsi, -8);
+         pop_store();
+         break;
+      case Type::slash:
+         division(false);
+         break;
+      case Type::percent:
+         division(true);
+         break;
+      case Type::equal:
+         compare(equal);
+         pop_store();
+         break;
+      case Type::less:
+         out.load(rax, rsi, -8);
+         out.arith(0x3b, rax, rsi, -16);
+         out.set(greater);
+         pop_store();
+         break;
+      case Type::greater:
+         out.load(rax, rsi, -8);
+         out.arith(0x3b, rax, rsi, -16);
+         out.set(less);
+         pop_store();
+         break;
+      case Type::exclamation:
+         out.load(rax, rsi, -8);
+         out.arith(0x85, rax, rax);
+         out.set(equal);
+         out.store(rsi, -8, rax);
+         break;
+      case Type::apostrophe:
+         out.negate(rsi, -8);
+         out.load(rax, rsi, -8);
+         break;
+      case Type::colon:
+         out.load(rax, rsi, -8);
+         out.store(rsi, 0, rax);
+         out.immediate(0, rsi, 8);
+         break;
+      case Type::dollar:
+         out.immediate(5, rsi, 8);
+         out.load(rax, rsi, 0);
+         break;
+      case Type::backslash:
+         out.load(rax, rsi, -16);
+         out.load(rcx, rsi, -8);
+         out.store(rsi, -16, rcx);
+         out.store(rsi, -8, rax);
+         break;
+      case Type::size:
+         out.arith(0x89, rax, rsi);
+         out.arith(0x29, rax, r8);
+         out.raw({0x48, 0xc1, 0xf8, 0x03});
+         out.store(rsi, 0, rax);
+         out.immediate(0, rsi, 8);
+         break;
+      case Type::set_reg:
+         out.load(rcx, rsi, -16);
+         out.arith(0x39, rcx, r11);
+         out.jump(above_equal, k);
+         out.load(rax, rsi, -8);
+         out.store_register();
+         out.immediate(5, rsi, 16);
+         break;
+      case Type::get_reg:
+         out.load(rcx, rsi, -8);
+         out.arith(0x39, rcx, r11);
+         out.jump(above_equal, k);
+         out.load_register();
+         out.store(rsi, -8, rax);
+         break;
+      default:
+         break;
+      }
+   }
+}
+
+// Loop
+
+namespace jit {
+   Loop::Loop(void* code, std::size_t size)
+      : code(code), size(size) {}
+
+   Loop::~Loop() {
+      munmap(code, size);
+   }
+
+   std::unique_ptr<Loop> Loop::compile(const Ast& ast, const Node& loop) {
+      auto& body = ast[loop.a];
+      std::vector<NodeId> stmts;
+
+      if (body.type == StmtType::program) {
+         if (body.d != no_node) {
+            return nullptr;
+         }
+         auto list = ast.list(body.c);
+         stmts.assign(list.begin(), list.end());
+      } else {
+         stmts.push_back(loop.a);
+      }
+
+      // Depth the stack needs below the body and the most it grows, relative to the height after
+      // the condition has been popped
+
+      int height = 0, need = 0, grow = 0;
+      for (auto stmt : stmts) {
+         Effect step;
+         if (!effect(ast, ast[stmt], step)) {
+            return nullptr;
+         }
+         need = std::max(need, step.need - height);
+         height += step.delta;
+         grow = std::max(grow, height);
+      }
+
+      if (stmts.empty()) {
+         return nullptr;
+      }
+
+      Emitter out;
+
+      // push rbx, push r12, xor r12d r12d, then load the frame
+
+      out.raw({0x53, 0x41, 0x54, 0x45, 0x31, 0xe4});
+      out.load(r8, rdi, frame_data);
+      out.load(rsi, rdi, frame_top);
+      out.load(r9, rdi, frame_end);
+      out.load(r10, rdi, frame_registers);
+      out.load(r11, rdi, frame_count);
+      out.load(rbx, rdi, frame_result);
+
+      // Pop and test the condition, the loop ends on an empty stack or a 0
+
+      auto head = out.code.size();
+      out.arith(0x39, rsi, r8);
+      out.jump(equal, Emitter::done);
+      out.immediate(5, rsi, 8);
+      out.load(rax, rsi, 0);
+      out.arith(0x85, rax, rax);
+      out.jump(equal, Emitter::done);
+
+      if (need > 0) {
+         out.arith(0x89, rax, rsi);
+         out.arith(0x29, rax, r8);
+         out.immediate(7, rax, need * 8);
+         out.jump(less, 0);
+      }
+
+      if (grow > 0) {
+         out.arith(0x89, rax, r9);
+         out.arith(0x29, rax, rsi);
+         out.immediate(7, rax, grow * 8);
+         out.jump(less, 0);
+      }
+
+      for (std::uint32_t k = 0; k < stmts.size(); ++k) {
+         emit_stmt(out, ast, ast[stmts[k]], k);
+      }
+
+      // mov rbx, rax and mov r12d, 1 record the completed iteration
+
+      out.arith(0x89, rbx, rax);
+      out.raw({0x41, 0xbc, 0x01, 0x00, 0x00, 0x00});
+      out.jump_back(head);
+      out.finish(stmts.size());
+
+      auto size = out.code.size();
+      auto code = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (code == MAP_FAILED) {
+         return nullptr;
+      }
+
+      std::memcpy(code, out.code.data(), size);
+      if (mprotect(code, size, PROT_READ | PROT_EXEC) != 0) {
+         munmap(code, size);
+         return nullptr;
+      }
+      return std::unique_ptr<Loop>(new Loop(code, size));
+   }
+}
+
+#else
+
+// Loop
+
+namespace jit {
+   Loop::Loop(void* code, std::size_t size)
+      : code(code), size(size) {}
+
+   Loop::~Loop() {}
+
+   std::unique_ptr<Loop> Loop::compile(const Ast& ast, const Node& loop) {
+      return nullptr;
+   }
+}
+
+#endif
@@ -2,111 +2,117 @@
 
 // Includes
 
-#include <iostream>
-#include <unordered_map>
+#include "errors.hpp"
+#include "stats.hpp"
+#include <algorithm>
 
 // Lexer functions
 
-Lexer::Lexer(const std::string& code)
+Lexer::Lexer(std::string_view code)
    : code(code) {}
 
 std::vector<Token>& Lexer::lex() {
-   for (int i = 0; i < code.size(); ++i) {
-      char ch = code.at(i);
+   stats::Timer timer (&stats::Counters::lex_time);
+   auto size = code.size();
+   tokens.reserve(size / 2 + 1);
+
+   for (std::size_t i = 0; i < size; ++i) {
+      auto ch = static_cast<unsigned char>(code[i]);
       
       if (isspace(ch)) {
+         if (ch == '\n') {
+            ++line;
+            line_start = i + 1;
+         }
          continue;
       }
 
-      if (ch == '/' && i + 1 < code.size() && code.at(i + 1) == '*') {
-         for (; i + 1 < code.size(); ++i) {
-            if (code.at(i) == '*' && code.at(i + 1) == '/') {
-               ++i;
-               break;
-            }
-         }
-
-         if (i >= code.size()) {
-            std::cerr << "Unterminated comment.\n";
-            std::exit(1);
-         }
+      if (ch == '/' && i + 1 < size && code[i + 1] == '*') {
+         // An unterminated comment runs to the end of the source
+         auto end = std::min(code.find("*/", i), size - 1);
+         newlines(i, end);
+         i = end + 1;
       } else if (isdigit(ch)) {
-         std::string number;
-         
-         for (; i < code.size() && isdigit(code.at(i)); ++i) {
-            number += code.at(i);
+         auto start = i;
+         while (i < size && isdigit(static_cast<unsigned char>(code[i]))) {
+            ++i;
          }
-         tokens.push_back({Type::number, number});
+         add(Type::number, start, i);
          --i;
       } else if (isalpha(ch) || ch == '_') {
-         std::string identifier;
-
-         for (; i < code.size() && (isalpha(code.at(i)) || code.at(i) == '_'); ++i) {
-            identifier += code.at(i);
+         auto start = i;
+         while (i < size && (isalpha(static_cast<unsigned char>(code[i])) || code[i] == '_')) {
+            ++i;
          }
 
-         if (auto it = keyword_ops.find(identifier); it != keyword_ops.end()) {
-            tokens.push_back({it->second, identifier});
-         } else if (keywords.find(identifier) != keywords.end()) {
-            tokens.push_back({Type::keyword, identifier});
+         auto identifier = code.substr(start, i - start);
+         auto symbol = keyword::find(identifier);
+         if (symbol >= keyword::Push) {
+            add(keyword_ops[symbol - keyword::Push], start, i, symbol);
+         } else if (symbol != keyword::none) {
+            add(Type::keyword, start, i, symbol);
          } else {
-            tokens.push_back({Type::identifier, identifier});
+            add(Type::identifier, start, i, symbol::intern(identifier));
          }
          --i;
       } else if (ch == '"') {
-         std::string string;
-
-         for (++i; i < code.size() && code.at(i) != '"'; ++i) {
-            if (code.at(i) == '\\' && i + 1 < code.size()) {
-               ++i;
-               string += as_escape(code.at(i));
-            } else {
-               string += code.at(i);
+         auto start = ++i;
+         for (; i < size && code[i] != '"'; ++i) {
+            if (code[i] == '\\' && i + 1 < size) {
+               if (!escape_code(code[++i])) {
+                  error::fail("Unknown escape code.");
+               }
             }
          }
-         tokens.push_back({Type::string, string});
+         add(Type::string, start, std::min(i, size));
+         newlines(start, i);
          
-         if (i >= code.size()) {
-            std::cerr << "Unterminated string.\n";
-            std::exit(1);
+         if (i >= size) {
+            error::fail("Unterminated string.");
          }
       } else {
-         std::string op;
-         for (int j = 0; j < max_op_size && j + i < code.size(); ++j) {
-            op += code.at(j + i);
-         }
-         auto original_size = op.size();
-
-         for (int j = 0; j < original_size; ++j) {
-            if (auto t = operators.find(op); t != operators.end()) {
-               tokens.push_back({t->second, op});
-               break;
-            }
-            op.pop_back();
+         auto [type, length] = find_operator(code.data() + i, size - i);
+         if (length == 0) {
+            error::fail("Unknown character.");
          }
-
-         if (op.empty()) {
-            std::cerr << "Unknown character.\n";
-            std::exit(1);
-         }
-         i += op.size() - 1;
+         add(type, i, i + length);
+         i += length - 1;
       }
    }
-   tokens.push_back({Type::eof, "EOF"});
+   add(Type::eof, size, size);
    return tokens;
 }
 
 // Helper functions
 
-char Lexer::as_escape(char ch) {
-   static const std::unordered_map<char, char> escape_codes {
-      {'a', '\a'}, {'b', '\b'}, {'t', '\t'}, {'n', '\n'}, {'v', '\v'}, {'f', '\f'},
-      {'r', '\r'}, {'e', '\e'}, {'\\', '\\'}, {'\'', '\''}, {'"', '"'}
-   };
+void Lexer::add(Type type, std::size_t start, std::size_t end, Symbol symbol) {
+   tokens.push_back({
+      type, symbol, std::uint32_t(start), std::uint32_t(end - start),
+      std::uint32_t(line), std::uint32_t(start - line_start + 1)
+   });
+}
+
+void Lexer::newlines(std::size_t start, std::size_t end) {
+   for (auto at = start; (at = code.find('\n', at)) < end; ++at) {
+      ++line;
+      line_start = at + 1;
+   }
+}
 
-   if (escape_codes.find(ch) == escape_codes.end()) {
-      std::cerr << "Unknown escape code.\n";
-      std::exit(1);
+std::string Lexer::unescape(std::string_view raw) {
+   if (raw.find('\\') == std::string_view::npos) {
+      return std::string(raw);
+   }
+
+   std::string string;
+   string.reserve(raw.size());
+
+   for (std::size_t i = 0; i < raw.size(); ++i) {
+      if (raw[i] == '\\' && i + 1 < raw.size()) {
+         string += escape_code(raw[++i]);
+      } else {
+         string += raw[i];
+      }
    }
-   return escape_codes.at(ch);
+   return string;
 }
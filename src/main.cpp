@@ -1,32 +1,261 @@
 // Includes
 
+#include "batch.hpp"
+#include "errors.hpp"
+#include "fuser.hpp"
+#include "image.hpp"
 #include "interpreter.hpp"
 #include "lexer.hpp"
+#include "modules.hpp"
+#include "output.hpp"
 #include "parser.hpp"
+#include "profiler.hpp"
+#include "resolver.hpp"
+#include "serve.hpp"
+#include "stack.hpp"
+#include "stats.hpp"
+#include "vm.hpp"
 #include <fstream>
 #include <iostream>
+#include <thread>
+#include <unistd.h>
+
+// Helper functions
+
+namespace {
+   void usage() {
+      std::cerr << "Usage: mei [options] <file or source>\n"
+                   "       mei [options] --batch <list>\n"
+                   "       mei [options] --serve <socket>\n"
+                   "\n"
+                   "Options:\n"
+                   "  --engine=tree|vm                    Evaluate with the tree walker or the bytecode VM\n"
+                   "  --no-fuse                           Do not fuse command sequences\n"
+                   "  --import-once                       Run each imported module once\n"
+                   "  --jit                               Compile hot loops of the tree walker\n"
+                   "  --flush=line|full|never-until-exit  When output is flushed\n"
+                   "  --registers=<count>                 Registers held in the dense range\n"
+                   "  --recursion-memory=<MiB>            Memory the VM may spend on calls\n"
+                   "  --compile <path>                    Write a program image instead of running\n"
+                   "  --profile <path>                    Write a profile of the run\n"
+                   "  --profile-mode=trace|sample         How the profile is taken\n"
+                   "  --stats                             Report runtime counters on exit\n"
+                   "  --threads=<count>                   Worker threads for --batch and --serve\n";
+   }
+}
 
 // Main function
 
 int main(int argc, char* argv[]) {
-   if (argc != 2) {
-      std::cerr << "Expected two arguments.\n";
+   std::string code, engine = "tree", output_path, batch_list, socket_path, profile_path;
+   bool fuse = true, import_once = false, jit = false, show_stats = false;
+   unsigned long registers = reg::default_size;
+   unsigned threads = std::thread::hardware_concurrency();
+   std::size_t recursion_memory = default_recursion_memory;
+   auto flush = (isatty(STDOUT_FILENO) ? output::Flush::line : output::Flush::full);
+   auto profile_mode = Profiler::Mode::trace;
+
+   for (int i = 1; i < argc; ++i) {
+      std::string arg = argv[i];
+
+      // The value of an option that takes the next argument
+
+      auto value = [&] {
+         if (i + 1 == argc) {
+            std::cerr << "Option '" << arg << "' expects a value.\n";
+            std::exit(1);
+         }
+         return std::string(argv[++i]);
+      };
+
+      if (arg.rfind("--engine=", 0) == 0) {
+         engine = arg.substr(9);
+      } else if (arg.rfind("--flush=", 0) == 0) {
+         auto policy = arg.substr(8);
+         if (policy == "line") {
+            flush = output::Flush::line;
+         } else if (policy == "full") {
+            flush = output::Flush::full;
+         } else if (policy == "never-until-exit") {
+            flush = output::Flush::never;
+         } else {
+            std::cerr << "Unknown flush policy '" << policy << "', expected 'line', 'full' or 'never-until-exit'.\n";
+            std::exit(1);
+         }
+      } else if (arg.rfind("--profile-mode=", 0) == 0) {
+         auto mode = arg.substr(15);
+         if (mode == "trace") {
+            profile_mode = Profiler::Mode::trace;
+         } else if (mode == "sample") {
+            profile_mode = Profiler::Mode::sample;
+         } else {
+            std::cerr << "Unknown profile mode '" << mode << "', expected 'trace' or 'sample'.\n";
+            std::exit(1);
+         }
+      } else if (arg == "--profile") {
+         profile_path = value();
+      } else if (arg == "--compile") {
+         output_path = value();
+      } else if (arg == "--batch") {
+         batch_list = value();
+      } else if (arg == "--serve") {
+         socket_path = value();
+      } else if (arg == "--import-once") {
+         import_once = true;
+      } else if (arg == "--jit") {
+         jit = true;
+      } else if (arg == "--stats") {
+         show_stats = true;
+      } else if (arg == "--no-fuse") {
+         fuse = false;
+      } else if (arg.rfind("--recursion-memory=", 0) == 0) {
+         auto size = arg.substr(19);
+         if (size.empty() || size.find_first_not_of("0123456789") != std::string::npos) {
+            std::cerr << "Invalid recursion memory '" << size << "'.\n";
+            std::exit(1);
+         }
+         recursion_memory = std::stoul(size) << 20;
+      } else if (arg.rfind("--registers=", 0) == 0) {
+         auto count = arg.substr(12);
+         if (count.empty() || count.find_first_not_of("0123456789") != std::string::npos) {
+            std::cerr << "Invalid register count '" << count << "'.\n";
+            std::exit(1);
+         }
+         registers = std::stoul(count);
+      } else if (arg.rfind("--threads=", 0) == 0) {
+         auto count = arg.substr(10);
+         if (count.empty() || count.find_first_not_of("0123456789") != std::string::npos) {
+            std::cerr << "Invalid thread count '" << count << "'.\n";
+            std::exit(1);
+         }
+         threads = std::stoul(count);
+      } else if (code.empty()) {
+         code = arg;
+      } else {
+         std::cerr << "Unexpected argument '" << arg << "'.\n";
+         std::exit(1);
+      }
+   }
+
+   if (code.empty() && batch_list.empty() && socket_path.empty()) {
+      usage();
+      std::exit(1);
+   }
+
+   if (engine != "tree" && engine != "vm") {
+      std::cerr << "Unknown engine '" << engine << "', expected 'tree' or 'vm'.\n";
+      std::exit(1);
+   }
+
+   if (!profile_path.empty() && (engine != "tree" || !batch_list.empty() || !socket_path.empty())) {
+      std::cerr << "Profiling needs a single run with the tree engine.\n";
+      std::exit(1);
+   }
+
+   if (show_stats && (!batch_list.empty() || !socket_path.empty())) {
+      std::cerr << "Stats need a single run.\n";
       std::exit(1);
    }
 
-   std::string code = argv[1];
-   std::ifstream file (code);
-   code = (file.is_open() ? std::string{std::istreambuf_iterator<char>{file}, {}} : code);
-   file.close();
-   
-   Lexer lexer (code);
-   auto& tokens = lexer.lex();
+   output::init(flush);
+
+   // Errors unwind to here, the 'Exit' command with status 0. The profile and the stats cover the
+   // run up to either.
+
+   std::unique_ptr<Profiler> profiler;
+   std::shared_ptr<Ast> program;
+   std::string path;
+   State state (registers);
+   stats::Counters counters;
+   int status = 0;
+
+   try {
+      if (!batch_list.empty() || !socket_path.empty()) {
+         mei::Options options;
+         options.engine = (engine == "vm" ? mei::Engine::vm : mei::Engine::tree);
+         options.fuse = fuse;
+         options.import_once = import_once;
+         options.jit = jit;
+         options.registers = registers;
+         options.recursion_memory = recursion_memory;
+
+         if (!socket_path.empty()) {
+            serve::run(socket_path, options, threads);
+         }
+         return batch::run(batch_list, options, threads);
+      }
+
+      state.enter();
+      if (show_stats) {
+         stats::start(counters);
+      }
+
+      if (code.ends_with(".meic") && image::is_image(code)) {
+         image::Imports imports;
+         program = image::load(code, imports);
+         program->bundle = modules::bundle(code, std::move(imports));
+         path = code;
+      } else {
+         std::ifstream file (code);
+         if (file.is_open()) {
+            path = code;
+            code.assign(std::istreambuf_iterator<char>{file}, {});
+         }
+         file.close();
+
+         Lexer lexer (code);
+         auto& tokens = lexer.lex();
 
-   Parser parser (tokens);
-   auto& program = parser.parse();
+         Parser parser (tokens, code);
+         program = parser.parse();
+      }
 
-   Environment env;
-   Interpreter interpreter;
-   interpreter.evaluate(program, env);
-   return 0;
+      if (!output_path.empty()) {
+         image::write(output_path, *program, image::collect_imports(*program));
+         return 0;
+      }
+
+      Resolver resolver;
+      resolver.resolve(*program);
+
+      if (fuse) {
+         Fuser fuser;
+         fuser.fuse(*program);
+      }
+
+      Environment env (program->scope((*program)[program->root].d));
+      if (engine == "vm") {
+         VM vm (fuse, import_once, recursion_memory);
+         if (!path.empty()) {
+            vm.source(path);
+         }
+         vm.run(*program, env);
+      } else {
+         Interpreter interpreter (fuse, import_once, jit);
+         if (!path.empty()) {
+            interpreter.source(path);
+         }
+         if (!profile_path.empty()) {
+            profiler = std::make_unique<Profiler>(profile_mode);
+            interpreter.profile(profiler.get());
+         }
+         interpreter.evaluate(*program, env);
+      }
+   } catch (const error::Exit& exit) {
+      if (!exit.message.empty()) {
+         std::cerr << exit.message << '\n';
+      }
+      status = exit.status;
+   }
+
+   if (show_stats) {
+      stats::stop();
+      counters.report(std::cerr);
+   }
+
+   if (profiler && !profiler->write(profile_path)) {
+      std::cerr << "Could not write profile '" << profile_path << "'.\n";
+      return 1;
+   }
+   return status;
 }
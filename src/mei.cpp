@@ -0,0 +1,173 @@
+#include "mei.hpp"
+
+// Includes
+
+#include "errors.hpp"
+#include "fuser.hpp"
+#include "input.hpp"
+#include "interpreter.hpp"
+#include "lexer.hpp"
+#include "output.hpp"
+#include "parser.hpp"
+#include "resolver.hpp"
+#include "stack.hpp"
+#include "stats.hpp"
+#include "vm.hpp"
+#include <fstream>
+#include <utility>
+
+// Functions
+
+namespace mei {
+   Status parse(std::string_view source, Program& program, const Options& options) {
+      try {
+         Lexer lexer (source);
+         auto& tokens = lexer.lex();
+
+         Parser parser (tokens, source);
+         auto ast = parser.parse();
+
+         Resolver resolver;
+         resolver.resolve(*ast);
+
+         if (options.fuse) {
+            Fuser fuser;
+            fuser.fuse(*ast);
+         }
+         program = std::move(ast);
+      } catch (const error::Exit& exit) {
+         return {exit.status, exit.message};
+      }
+      return {};
+   }
+
+   bool read_file(const std::string& path, std::string& text) {
+      std::ifstream file (path, std::ios::binary);
+      if (!file.is_open()) {
+         return false;
+      }
+      text.assign(std::istreambuf_iterator<char>{file}, {});
+      return true;
+   }
+}
+
+// Cache
+
+namespace mei {
+   Cache::Cache(Options options, std::size_t capacity)
+      : options(options), capacity(capacity) {}
+
+   Status Cache::get(const std::string& source, Program& program) {
+      std::shared_ptr<Entry> entry;
+      {
+         std::lock_guard lock (mutex);
+         if (entries.size() >= capacity && !entries.contains(source)) {
+            entries.clear();
+         }
+
+         auto& slot = entries[source];
+         if (!slot) {
+            slot = std::make_shared<Entry>();
+         }
+         entry = slot;
+      }
+
+      std::call_once(entry->once, [&] {
+         entry->status = parse(source, entry->program, options);
+      });
+      program = entry->program;
+      return entry->status;
+   }
+}
+
+// Instance
+
+namespace mei {
+   Instance::Instance(Options options)
+      : options(options), state(options.registers) {
+      out.policy = output::Flush::never;
+   }
+
+   Status Instance::run(std::string_view source, std::string input) {
+      Program program;
+      auto counters = std::exchange(stats::counters, (options.stats ? &gathered : stats::counters));
+      auto status = parse(source, program, options);
+      stats::counters = counters;
+
+      if (!status.ok()) {
+         return status;
+      }
+      return run(program, std::move(input));
+   }
+
+   Status Instance::run(const Program& program, std::string input, const std::string& path) {
+      input::provide(std::move(input));
+      state.enter();
+      auto target = std::exchange(output::target, &out);
+      Status status;
+
+      if (options.stats) {
+         stats::start(gathered);
+      }
+
+      try {
+         Environment env (program->scope((*program)[program->root].d));
+         if (options.engine == Engine::vm) {
+            VM vm (options.fuse, options.import_once, options.recursion_memory);
+            if (!path.empty()) {
+               vm.source(path);
+            }
+            vm.run(*program, env);
+         } else {
+            Interpreter interpreter (options.fuse, options.import_once, options.jit);
+            if (!path.empty()) {
+               interpreter.source(path);
+            }
+            interpreter.evaluate(*program, env);
+         }
+      } catch (const error::Exit& exit) {
+         status = {exit.status, exit.message};
+      }
+
+      if (out.sink) {
+         out.write_out();
+      }
+      if (options.stats) {
+         stats::stop();
+      }
+      output::target = target;
+      state.leave();
+      return status;
+   }
+
+   void Instance::stream(std::function<void(std::string_view)> sink) {
+      if (!sink) {
+         out.policy = output::Flush::never;
+         out.sink = nullptr;
+         return;
+      }
+
+      out.policy = output::Flush::full;
+      out.sink = [sink = std::move(sink)](const char* data, std::size_t size) {
+         sink({data, size});
+      };
+   }
+
+   std::vector<long> Instance::stack() const {
+      return state.stack();
+   }
+
+   std::string Instance::output() {
+      return out.take();
+   }
+
+   void Instance::reset() {
+      state.clear();
+      out.take();
+      gathered = {};
+   }
+
+   const stats::Counters& Instance::counters() const {
+      return gathered;
+   }
+}
@@ -0,0 +1,201 @@
+#include "modules.hpp"
+
+// Includes
+
+#include "errors.hpp"
+#include "fuser.hpp"
+#include "image.hpp"
+#include "lexer.hpp"
+#include "parser.hpp"
+#include "resolver.hpp"
+#include "stats.hpp"
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+
+// Module cache
+
+namespace {
+   // A cache slot, compiled by the first import that asks for it while imports of the same module
+   // wait for that one and all others go ahead. A failure is kept like a module, as the same text
+   // fails the same way again.
+
+   struct Entry {
+      std::once_flag once;
+      std::shared_ptr<Module> module;
+      std::optional<error::Exit> error;
+      std::filesystem::file_time_type mtime;
+      std::uintmax_t size = 0;
+   };
+
+   // Inline code and every load of an image add keys of their own, so like mei::Cache the cache
+   // starts over once it holds 'capacity' modules. Modules still in use stay alive through their
+   // own references.
+
+   constexpr std::size_t capacity = 4096;
+
+   std::mutex mutex;
+   std::unordered_map<std::string, std::shared_ptr<Entry>> cache;
+   std::atomic<std::uint64_t> bundles = 0;
+
+   std::shared_ptr<Ast> prepare(std::shared_ptr<Ast> program, bool fuse) {
+      Resolver resolver;
+      resolver.resolve_import(*program);
+
+      if (fuse) {
+         Fuser fuser;
+         fuser.fuse(*program);
+      }
+      return program;
+   }
+
+   std::shared_ptr<const Ast> find_embedded(const Bundle* bundle, const std::string& code) {
+      if (!bundle) {
+         return nullptr;
+      }
+      auto it = bundle->modules.find(code);
+      return (it == bundle->modules.end() ? nullptr : it->second);
+   }
+
+   std::shared_ptr<Ast> compile(const std::string& source, bool fuse) {
+      Lexer lexer (source);
+      auto& tokens = lexer.lex();
+
+      Parser parser (tokens, source);
+      return prepare(parser.parse(), fuse);
+   }
+
+   std::shared_ptr<Ast> compile_file(std::ifstream& file, const std::string& path, bool fuse) {
+      if (path.ends_with(".meic") && image::is_image(path)) {
+         image::Imports imports;
+         auto program = image::load(path, imports);
+         program->bundle = modules::bundle(path, std::move(imports));
+         return prepare(std::move(program), fuse);
+      }
+      return compile(std::string{std::istreambuf_iterator<char>{file}, {}}, fuse);
+   }
+
+   // Returns the module cached under 'key', compiling it with 'compile' when there is none yet or
+   // the file it was compiled from has changed since. Only the lookup holds the lock.
+
+   template <typename Compile>
+   std::shared_ptr<Module> build(const std::string& key, std::filesystem::file_time_type mtime, std::uintmax_t size, Compile compile) {
+      std::shared_ptr<Entry> entry;
+      {
+         std::lock_guard lock (mutex);
+         if (cache.size() >= capacity && !cache.contains(key)) {
+            cache.clear();
+         }
+
+         auto& slot = cache[key];
+         if (!slot || slot->mtime != mtime || slot->size != size) {
+            slot = std::make_shared<Entry>();
+            slot->mtime = mtime;
+            slot->size = size;
+         }
+         entry = slot;
+      }
+
+      std::call_once(entry->once, [&] {
+         try {
+            auto module = std::make_shared<Module>();
+            module->key = key;
+            module->mtime = mtime;
+            module->size = size;
+            module->program = compile();
+            entry->module = std::move(module);
+         } catch (const error::Exit& exit) {
+            entry->error = exit;
+         }
+      });
+
+      if (entry->error) {
+         throw *entry->error;
+      }
+      return entry->module;
+   }
+}
+
+namespace modules {
+   std::shared_ptr<const Bundle> bundle(const std::string& path, image::Imports imports) {
+      std::error_code error;
+      auto canonical = std::filesystem::canonical(path, error);
+
+      auto bundle = std::make_shared<Bundle>();
+      bundle->key = (error ? path : canonical.string()) + "#" + std::to_string(++bundles);
+      bundle->modules.insert(imports.begin(), imports.end());
+      return bundle;
+   }
+
+   std::shared_ptr<Module> load(const std::string& code, bool fuse, const std::shared_ptr<const Bundle>& bundle) {
+      std::string prefix = (fuse ? "fused:" : "plain:");
+
+      // Resolving and fusing work in place, so every fuse setting prepares a copy of its own
+
+      if (auto embedded = find_embedded(bundle.get(), code)) {
+         return build(prefix + "embedded:" + bundle->key + ":" + code, {}, 0, [&] {
+            auto program = std::make_shared<Ast>(*embedded);
+            program->bundle = bundle;
+            return prepare(std::move(program), fuse);
+         });
+      }
+
+      std::ifstream file (code);
+      if (!file.is_open()) {
+         return build(prefix + code, {}, 0, [&] {
+            return compile(code, fuse);
+         });
+      }
+
+      std::error_code error;
+      auto mtime = std::filesystem::last_write_time(code, error);
+      auto size = std::filesystem::file_size(code, error);
+
+      return build(key(code, fuse), mtime, size, [&] {
+         return compile_file(file, code, fuse);
+      });
+   }
+
+   std::string key(const std::string& path, bool fuse) {
+      std::error_code error;
+      auto canonical = std::filesystem::canonical(path, error);
+      return (fuse ? "fused:" : "plain:") + (error ? path : canonical.string());
+   }
+}
+
+// Importer
+
+Importer::Importer(bool fuse, bool once)
+   : fuse(fuse), once(once) {}
+
+// Loads the module named by an 'Import' argument and marks it as being imported, returns null
+// when it has already been imported and 'once' is set
+
+std::shared_ptr<Module> Importer::enter(const std::string& code, const std::shared_ptr<const Bundle>& bundle) {
+   if (stats::counters) [[unlikely]] {
+      ++stats::counters->imports;
+   }
+
+   auto module = modules::load(code, fuse, bundle);
+
+   if (std::find(active.begin(), active.end(), module->key) != active.end()) {
+      error::fail("Cyclic import of '" + code + "'.");
+   }
+
+   if (once && !imported.insert(module->key).second) {
+      return nullptr;
+   }
+   active.push_back(module->key);
+   return module;
+}
+
+void Importer::leave() {
+   active.pop_back();
+}
+
+void Importer::root(const std::string& path) {
+   active.push_back(modules::key(path, fuse));
+}
@@ -0,0 +1,129 @@
+#include "output.hpp"
+
+// Includes
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <iostream>
+#include <unistd.h>
+
+// Helper functions
+
+static void write_all(const char* data, std::size_t size) {
+   while (size > 0) {
+      auto result = ::write(STDOUT_FILENO, data, size);
+      if (result < 0 && errno == EINTR) {
+         continue;
+      }
+
+      if (result <= 0) {
+         return;
+      }
+      data += result;
+      size -= result;
+   }
+}
+
+// Buffer
+
+namespace output {
+   constexpr std::size_t buffer_size = 1 << 16;
+
+   Buffer buffer;
+   constinit thread_local Buffer* target = &buffer;
+   std::streambuf* original = nullptr;
+
+   Buffer::Buffer()
+      : storage(buffer_size) {
+      setp(storage.data(), storage.data() + storage.size());
+   }
+
+   // Makes room for 'size' more bytes, by writing the buffer out or, when nothing may be written
+   // before exit, by growing it
+
+   void Buffer::make_room(std::size_t size) {
+      if (policy != Flush::never) {
+         write_out();
+         return;
+      }
+
+      auto used = pptr() - pbase();
+      storage.resize(std::max(storage.size() * 2, used + size));
+      setp(storage.data(), storage.data() + storage.size());
+      pbump(used);
+   }
+
+   Buffer::int_type Buffer::overflow(int_type ch) {
+      make_room(1);
+      if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+         *pptr() = traits_type::to_char_type(ch);
+         pbump(1);
+      }
+      return traits_type::not_eof(ch);
+   }
+
+   std::streamsize Buffer::xsputn(const char* data, std::streamsize size) {
+      if (size > epptr() - pptr()) {
+         make_room(size);
+      }
+
+      if (size > epptr() - pptr()) {
+         emit(data, size);
+         return size;
+      }
+      std::memcpy(pptr(), data, size);
+      pbump(size);
+      return size;
+   }
+
+   int Buffer::sync() {
+      write_out();
+      return 0;
+   }
+
+   void Buffer::write_out() {
+      emit(pbase(), pptr() - pbase());
+      setp(storage.data(), storage.data() + storage.size());
+   }
+
+   void Buffer::emit(const char* data, std::size_t size) {
+      if (sink) {
+         sink(data, size);
+      } else {
+         write_all(data, size);
+      }
+   }
+
+   std::string Buffer::take() {
+      std::string text (pbase(), pptr());
+      setp(storage.data(), storage.data() + storage.size());
+      return text;
+   }
+
+   // Functions
+
+   void init(Flush policy) {
+      buffer.policy = policy;
+
+      if (!original) {
+         original = std::cout.rdbuf(&buffer);
+         std::cin.tie(nullptr);
+
+         std::atexit([] {
+            buffer.write_out();
+            std::cout.rdbuf(original);
+         });
+      }
+   }
+
+   void flush() {
+      target->write_out();
+   }
+
+   void flush_for_input() {
+      if (target->policy != Flush::never) {
+         target->write_out();
+      }
+   }
+}
@@ -2,192 +2,197 @@
 
 // Includes
 
-#include <iostream>
+#include "errors.hpp"
+#include "lexer.hpp"
+#include "stats.hpp"
+#include <charconv>
 
 // Parser
 
-Parser::Parser(std::vector<Token>& tokens)
-   : tokens(tokens), program(std::vector<Stmt>{}) {}
+Parser::Parser(std::vector<Token>& tokens, std::string_view code)
+   : tokens(tokens), code(code), ast(std::make_shared<Ast>()) {}
 
-Program& Parser::parse() {
+std::shared_ptr<Ast> Parser::parse() {
+   stats::Timer timer (&stats::Counters::parse_time);
+   std::vector<NodeId> stmts;
    while (!is(Type::eof)) {
-      program.stmts.push_back(std::move(parse_expr()));
+      stmts.push_back(parse_expr());
    }
-   return program;
+   ast->root = ast->add({StmtType::program, 0, 0, no_node, no_node, ast->add_list(stmts)});
+   return ast;
 }
 
 // Parse functions
 
 // Parse statements
 
-Stmt Parser::parse_stmt() {
-   auto& token = current();
+NodeId Parser::parse_stmt() {
+   error::check_stack("Program is nested too deeply.");
 
-   if (token.lexeme == "Const") {
+   switch (current().symbol) {
+   case keyword::Const:
       return parse_var_decl();
-   } else if (token.lexeme == "Fn") {
+   case keyword::Fn:
       return parse_fn_decl();
-   } else if (token.lexeme == "While") {
+   case keyword::While:
       return parse_while_loop();
-   } else if (token.lexeme == "Break") {
+   case keyword::Break:
       return parse_break_stmt();
-   } else if (token.lexeme == "Continue") {
+   case keyword::Continue:
       return parse_continue_stmt();
-   } else if (token.lexeme == "Import") {
+   case keyword::Import:
       return parse_import();
-   } else {
-      std::cerr << "Unknown keyword.\n";
-      std::exit(1);
+   default:
+      error::fail("Unknown keyword.");
    }
 }
 
-Stmt Parser::parse_var_decl() {
+NodeId Parser::parse_var_decl() {
    advance();
    auto identifier = parse_expr(), value = parse_expr();
-   return VarDecl::make(identifier, value);
+   return ast->add({StmtType::var_decl, 0, 0, identifier, value});
 }
 
-Stmt Parser::parse_fn_decl() {
+NodeId Parser::parse_fn_decl() {
    advance();
    auto identifier = parse_primary_expr();
 
    if (!is(Type::open_paren)) {
-      std::cerr << "Expected 'open_paren' after identifier in function declaration.\n";
-      std::exit(1);
+      error::fail("Expected 'open_paren' after identifier in function declaration.");
    }
    advance();
 
-   std::vector<Stmt> params;
+   std::vector<NodeId> params;
    while (!is(Type::close_paren)) {
       params.push_back(parse_expr());
    }
 
    if (!is(Type::close_paren)) {
-      std::cerr << "Unterminated parameter list.\n";
-      std::exit(1);
+      error::fail("Unterminated parameter list.");
    }
    advance();
    auto body = parse_expr();
-   return FnDecl::make(identifier, body, params);
+   return ast->add({StmtType::fn_decl, 0, 0, identifier, body, ast->add_list(params)});
 }
 
-Stmt Parser::parse_while_loop() {
+NodeId Parser::parse_while_loop() {
    advance();
    auto body = parse_expr();
-   return WhileLoop::make(body);
+   return ast->add({StmtType::while_loop, 0, 0, body});
 }
 
-Stmt Parser::parse_break_stmt() {
+NodeId Parser::parse_break_stmt() {
    advance();
-   return BreakStmt::make();
+   return ast->add({StmtType::break_stmt});
 }
 
-Stmt Parser::parse_continue_stmt() {
+NodeId Parser::parse_continue_stmt() {
    advance();
-   return ContinueStmt::make();
+   return ast->add({StmtType::continue_stmt});
 }
 
-Stmt Parser::parse_push_stmt() {
+NodeId Parser::parse_push_stmt() {
    advance();
    auto expr = parse_expr();
-   return PushStmt::make(expr);
+   return ast->add({StmtType::push, 0, 0, expr});
 }
 
-Stmt Parser::parse_type_stmt() {
+NodeId Parser::parse_type_stmt() {
    advance();
    auto expr = parse_expr();
-   return TypeStmt::make(expr);
+   return ast->add({StmtType::type, 0, 0, expr});
 }
 
-Stmt Parser::parse_import() {
+NodeId Parser::parse_import() {
    advance();
    auto import = parse_expr();
-   return ImportStmt::make(import);
+   return ast->add({StmtType::import, 0, 0, import});
 }
 
 // Parse expressions
 
-Stmt Parser::parse_expr() {
+NodeId Parser::parse_expr() {
+   error::check_stack("Program is nested too deeply.");
    return parse_ternary_expr();
 }
 
-Stmt Parser::parse_ternary_expr() {
+NodeId Parser::parse_ternary_expr() {
    auto left = parse_call_expr();
 
    while (is(Type::pipe)) {
       advance();
       auto right = parse_expr();
-      left = TernaryExpr::make(left, right);
+      left = ast->add({StmtType::ternary, 0, 0, left, right});
    }
    return left;
 }
 
-Stmt Parser::parse_call_expr() {
+NodeId Parser::parse_call_expr() {
    auto identifier = parse_primary_expr();
-   if (identifier->type != StmtType::identifier) {
+   if ((*ast)[identifier].type != StmtType::identifier) {
       return identifier;
    }
 
    while (is(Type::open_paren)) {
       advance();
 
-      std::vector<Stmt> args;
+      std::vector<NodeId> args;
       while (!is(Type::close_paren)) {
          args.push_back(parse_expr());
       }
 
       if (!is(Type::close_paren)) {
-         std::cerr << "Unterminated argument list.\n";
-         std::exit(1);
+         error::fail("Unterminated argument list.");
       }
       advance();
-      identifier = CallExpr::make(identifier, args);
+      identifier = ast->add({StmtType::call, 0, 0, identifier, no_node, ast->add_list(args)});
    }
    return identifier;
 }
 
 // Parse primary expressions
 
-Stmt Parser::parse_primary_expr() {
+NodeId Parser::parse_primary_expr() {
    if (is(Type::identifier)) {
-      std::string identifier = current().lexeme;
+      auto identifier = current().symbol;
       advance();
-      return IdentLiteral::make(identifier);
+      return ast->add({StmtType::identifier, 0, 0, identifier});
    } else if (is(Type::number)) {
       long number = 0;
+      auto lexeme = current().lexeme(code);
 
-      try {
-         number = std::stol(current().lexeme);
-      } catch (...) {
-         std::cerr << "Could not convert string to number.\n";
-         std::exit(1);
+      if (std::from_chars(lexeme.data(), lexeme.data() + lexeme.size(), number).ec != std::errc{}) {
+         error::fail("Could not convert string to number.");
       }
       advance();
-      return NumberLiteral::make(number);
+
+      Node literal {StmtType::number};
+      literal.set_number(number);
+      return ast->add(literal);
    } else if (is(Type::string)) {
-      std::string string = current().lexeme;
+      auto string = Lexer::unescape(current().lexeme(code));
       advance();
-      return StringLiteral::make(string);
+      return ast->add({StmtType::string, 0, 0, ast->add_string(std::move(string))});
    } else if (is(Type::open_brace)) {
       advance();
-      std::vector<Stmt> stmts;
+      std::vector<NodeId> stmts;
 
       while (!is(Type::close_brace)) {
          auto stmt = parse_expr();
          stmts.push_back(stmt);
       }
       advance();
-      return Program::make(stmts);
+      return ast->add({StmtType::program, 0, 0, no_node, no_node, ast->add_list(stmts)});
    } else if (is(Type::open_bracket)) {
       advance();
-      std::vector<Stmt> stmts;
+      std::vector<NodeId> stmts;
 
       while (!is(Type::close_bracket)) {
          auto stmt = parse_expr();
          stmts.push_back(stmt);
       }
       advance();
-      return ArrayLiteral::make(stmts);
+      return ast->add({StmtType::array, 0, 0, no_node, no_node, ast->add_list(stmts)});
    } else if (is(Type::keyword)) {
       return parse_stmt();
    } else if (is(Type::semicolon)) {
@@ -196,10 +201,9 @@ Stmt Parser::parse_primary_expr() {
       return parse_type_stmt();
    } else if (is(Type::hash)) {
       advance();
-      return PullStmt::make();
+      return ast->add({StmtType::pull});
    } else if (is(Type::eof)) {
-      std::cerr << "Unexpected token: 'EOF'.\n";
-      std::exit(1);
+      error::fail("Unexpected token: 'EOF'.");
    } else {
       auto type = current().type;
       advance();
@@ -207,9 +211,9 @@ Stmt Parser::parse_primary_expr() {
       if (is(Type::times)) {
          advance();
          auto times = parse_expr();
-         return Command::make(type, std::optional(times));
+         return ast->add({StmtType::command, std::uint8_t(type), 0, times});
       }
-      return Command::make(type, std::nullopt);
+      return ast->add({StmtType::command, std::uint8_t(type)});
    }
 }
 
@@ -0,0 +1,80 @@
+#include "pool.hpp"
+
+// Includes
+
+#include <algorithm>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+// Queue
+
+namespace {
+   struct Queue {
+      std::mutex mutex;
+      std::deque<std::size_t> jobs;
+
+      std::optional<std::size_t> take() {
+         std::lock_guard lock (mutex);
+         if (jobs.empty()) {
+            return std::nullopt;
+         }
+         auto job = jobs.back();
+         jobs.pop_back();
+         return job;
+      }
+
+      std::optional<std::size_t> steal() {
+         std::lock_guard lock (mutex);
+         if (jobs.empty()) {
+            return std::nullopt;
+         }
+         auto job = jobs.front();
+         jobs.pop_front();
+         return job;
+      }
+   };
+}
+
+// Functions
+
+namespace pool {
+   void run(std::size_t count, unsigned threads, const std::function<void(unsigned worker, std::size_t job)>& work) {
+      threads = std::max(1u, threads);
+      std::vector<Queue> queues (threads);
+
+      // Each queue holds a contiguous run, taken from the back so that the front is stolen first
+
+      for (std::size_t job = 0; job < count; ++job) {
+         queues[job * threads / count].jobs.push_back(job);
+      }
+
+      auto worker = [&](unsigned self) {
+         for (;;) {
+            auto job = queues[self].take();
+            for (unsigned i = 1; !job && i < threads; ++i) {
+               job = queues[(self + i) % threads].steal();
+            }
+
+            // Jobs never add jobs, so once every queue is empty there is nothing left to steal
+
+            if (!job) {
+               return;
+            }
+            work(self, *job);
+         }
+      };
+
+      std::vector<std::thread> workers;
+      for (unsigned i = 1; i < threads; ++i) {
+         workers.emplace_back(worker, i);
+      }
+      worker(0);
+
+      for (auto& thread : workers) {
+         thread.join();
+      }
+   }
+}
@@ -0,0 +1,298 @@
+#include "profiler.hpp"
+
+// Includes
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <sys/time.h>
+
+// Helper functions
+
+namespace {
+   struct sigaction previous;
+
+   std::int64_t now() {
+      return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+   }
+
+   std::string name_of(const Ast& ast, NodeId id) {
+      auto& node = ast[id];
+      return (node.type == StmtType::identifier ? symbol::name(node.a) : std::string{});
+   }
+
+   std::string describe(Fusion fusion, long operand) {
+      switch (fusion) {
+      case Fusion::dup_multiply:  return ": *";
+      case Fusion::swap_subtract: return "\\ -";
+      case Fusion::equal_not:     return "= !";
+      default:                    break;
+      }
+
+      constexpr std::string_view ops[] {"+", "-", "*", "/", "%", "=", "<", ">"};
+      auto op = ops[int(fusion) - int(Fusion::push_add)];
+      return ";" + std::to_string(operand) + " " + std::string(op);
+   }
+
+   // A short rendering of a statement for the report
+
+   std::string describe(const Ast& ast, const Node& node) {
+      switch (node.type) {
+      case StmtType::var_decl:      return "Const " + name_of(ast, node.a);
+      case StmtType::fn_decl:       return "Fn " + name_of(ast, node.a);
+      case StmtType::while_loop:    return "While";
+      case StmtType::import:        return "Import";
+      case StmtType::break_stmt:    return "Break";
+      case StmtType::continue_stmt: return "Continue";
+      case StmtType::ternary:       return "{ } | { }";
+      case StmtType::call:          return name_of(ast, node.a) + "()";
+      case StmtType::command:       return std::string(spelling(Type(node.op))) + (node.a == no_node ? "" : " (repeated)");
+      case StmtType::fused:         return describe(Fusion(node.op), node.number());
+      case StmtType::push:          return (ast[node.a].type == StmtType::number ? ";" + std::to_string(ast[node.a].number()) : "Push");
+      case StmtType::type:          return "Type";
+      case StmtType::pull:          return "#";
+      case StmtType::identifier:    return symbol::name(node.a);
+      case StmtType::number:        return std::to_string(node.number());
+      case StmtType::string:        return "string";
+      case StmtType::array:         return "array";
+      case StmtType::program:       return "{ }";
+      }
+      return "";
+   }
+
+   // Commands are reported by operator, fused ones without their operand
+
+   std::string command_of(Fusion fusion) {
+      auto text = describe(fusion, 0);
+      return (text[0] == ';' ? ";n" + text.substr(2) : text);
+   }
+
+   std::string command_of(const Node& node) {
+      return (node.type == StmtType::fused ? command_of(Fusion(node.op)) : std::string(spelling(Type(node.op))));
+   }
+
+   std::string function_name(Symbol name) {
+      return (name == keyword::none ? "main" : symbol::name(name));
+   }
+}
+
+// Profiler
+
+volatile std::sig_atomic_t Profiler::pending = 0;
+
+void Profiler::on_timer(int) {
+   pending = 1;
+}
+
+Profiler::Profiler(Mode mode, unsigned rate)
+   : mode(mode), rate(std::max(rate, 1u)), started(now()) {
+   frames.push_back({0, nullptr, keyword::none});
+
+   if (mode == Mode::sample) {
+      struct sigaction action {};
+      action.sa_handler = on_timer;
+      action.sa_flags = SA_RESTART;
+      sigemptyset(&action.sa_mask);
+      sigaction(SIGPROF, &action, &previous);
+
+      itimerval timer {};
+      timer.it_interval.tv_usec = std::max(1000000 / this->rate, 1u);
+      timer.it_value = timer.it_interval;
+      setitimer(ITIMER_PROF, &timer, nullptr);
+   }
+}
+
+Profiler::~Profiler() {
+   if (mode == Mode::sample) {
+      itimerval timer {};
+      setitimer(ITIMER_PROF, &timer, nullptr);
+      sigaction(SIGPROF, &previous, nullptr);
+      pending = 0;
+   }
+}
+
+Profiler::Stats& Profiler::stats(const Ast& ast, const Node& node) {
+   return nodes.try_emplace(&node, Stats{&ast, ast.id(node), frames[current].name}).first->second;
+}
+
+void Profiler::sample(const Ast& ast, const Node& node) {
+   ++samples;
+   ++stats(ast, node).count;
+   ++frames[current].weight;
+}
+
+// Statement hooks
+
+void Profiler::begin(const Ast& ast, const Node& node) {
+   auto& entry = stats(ast, node);
+   ++entry.active;
+   open.push_back({&entry, now()});
+}
+
+void Profiler::end() {
+   auto top = open.back();
+   open.pop_back();
+
+   auto elapsed = now() - top.start;
+   auto& entry = *top.stats;
+   ++entry.count;
+   entry.exclusive += elapsed - top.children;
+   frames[current].weight += elapsed - top.children;
+
+   // A statement that is still running further up, as in a recursive call, already counts this
+   // time in its own inclusive time
+
+   if (--entry.active == 0) {
+      entry.inclusive += elapsed;
+   }
+
+   if (!open.empty()) {
+      open.back().children += elapsed;
+   }
+}
+
+// Function hooks
+
+void Profiler::enter(const Node& body, Symbol name) {
+   auto& function = functions.try_emplace(&body, Function{std::uint32_t(functions.size()), name}).first->second;
+   ++function.calls;
+
+   auto key = std::uint64_t(current) << 32 | function.index;
+   auto [child, inserted] = children.try_emplace(key, frames.size());
+   if (inserted) {
+      frames.push_back({current, &body, name});
+   }
+   current = child->second;
+}
+
+void Profiler::leave() {
+   current = frames[current].parent;
+}
+
+// Report
+
+bool Profiler::write(const std::string& path) const {
+   std::ofstream out (path);
+   std::ofstream folded (path + ".folded");
+   if (!out.is_open() || !folded.is_open()) {
+      return false;
+   }
+
+   auto tracing = (mode == Mode::trace);
+   auto ms = [](std::int64_t ns) {
+      return double(ns) / 1e6;
+   };
+
+   out << std::fixed << std::setprecision(3);
+   if (tracing) {
+      out << "Profile of " << ms(now() - started) << " ms, traced\n";
+   } else {
+      out << "Profile of " << samples << " samples at up to " << rate << " Hz of CPU time\n";
+   }
+
+   // Statements by exclusive time, or by samples
+
+   std::vector<const Stats*> sorted;
+   for (auto& [node, entry] : nodes) {
+      sorted.push_back(&entry);
+   }
+   std::sort(sorted.begin(), sorted.end(), [&](auto a, auto b) {
+      return (tracing ? a->exclusive > b->exclusive : a->count > b->count);
+   });
+
+   out << "\nStatements\n\n";
+   if (tracing) {
+      out << std::setw(12) << "count" << std::setw(14) << "inclusive ms" << std::setw(14) << "exclusive ms" << "  statement\n";
+   } else {
+      out << std::setw(12) << "samples" << "  statement\n";
+   }
+
+   for (auto entry : sorted) {
+      out << std::setw(12) << entry->count;
+      if (tracing) {
+         out << std::setw(14) << ms(entry->inclusive) << std::setw(14) << ms(entry->exclusive);
+      }
+      out << "  " << describe(*entry->ast, (*entry->ast)[entry->id]) << "  [" << function_name(entry->function) << " #" << entry->id << "]\n";
+   }
+
+   // Functions by calls, with the time or samples spent in their own statements
+
+   std::map<const Node*, std::int64_t> self;
+   for (auto& frame : frames) {
+      self[frame.body] += frame.weight;
+   }
+
+   std::vector<std::pair<const Node*, const Function*>> called;
+   for (auto& [body, function] : functions) {
+      called.emplace_back(body, &function);
+   }
+   std::sort(called.begin(), called.end(), [](auto& a, auto& b) {
+      return a.second->calls > b.second->calls;
+   });
+
+   out << "\nFunctions\n\n" << std::setw(12) << "calls" << std::setw(14) << (tracing ? "self ms" : "self samples") << "  function\n";
+   for (auto& [body, function] : called) {
+      out << std::setw(12) << function->calls << std::setw(14);
+      if (tracing) {
+         out << ms(self[body]);
+      } else {
+         out << self[body];
+      }
+      out << "  " << function_name(function->name) << '\n';
+   }
+
+   // Commands by executions, or by samples
+
+   std::map<std::string, std::uint64_t> executed;
+   if (tracing) {
+      for (std::size_t op = 0; op < std::size(commands); ++op) {
+         if (commands[op]) {
+            executed[std::string(spelling(Type(op)))] += commands[op];
+         }
+      }
+      for (std::size_t fusion = 0; fusion < std::size(fusions); ++fusion) {
+         if (fusions[fusion]) {
+            executed[command_of(Fusion(fusion))] += fusions[fusion];
+         }
+      }
+   } else {
+      for (auto& [node, entry] : nodes) {
+         if (node->type == StmtType::command || node->type == StmtType::fused) {
+            executed[command_of(*node)] += entry.count;
+         }
+      }
+   }
+
+   std::vector<std::pair<std::string, std::uint64_t>> ranked (executed.begin(), executed.end());
+   std::stable_sort(ranked.begin(), ranked.end(), [](auto& a, auto& b) {
+      return a.second > b.second;
+   });
+
+   out << "\nCommands\n\n" << std::setw(12) << (tracing ? "count" : "samples") << "  command\n";
+   for (auto& [command, count] : ranked) {
+      out << std::setw(12) << count << "  " << command << '\n';
+   }
+
+   // Folded stacks, one line per call path with its weight in microseconds or samples
+
+   for (std::uint32_t i = 0; i < frames.size(); ++i) {
+      auto weight = (tracing ? frames[i].weight / 1000 : frames[i].weight);
+      if (weight <= 0) {
+         continue;
+      }
+
+      std::vector<std::string> path;
+      for (auto frame = i; frame != 0; frame = frames[frame].parent) {
+         path.push_back(function_name(frames[frame].name));
+      }
+
+      folded << "main";
+      for (auto name = path.rbegin(); name != path.rend(); ++name) {
+         folded << ';' << *name;
+      }
+      folded << ' ' << weight << '\n';
+   }
+   return out.good() && folded.good();
+}
@@ -0,0 +1,273 @@
+#include "resolver.hpp"
+
+// Includes
+
+#include "errors.hpp"
+
+// Resolver
+
+void Resolver::resolve(Ast& program) {
+   ast = &program;
+   frames.push_back({std::make_shared<Scope>()});
+   for (auto& [name, value] : builtins()) {
+      frames.back().scope->declare(name);
+   }
+
+   auto stmts = program.list(program[program.root].c);
+   for (auto stmt : stmts) {
+      declare(stmt);
+   }
+
+   for (auto stmt : stmts) {
+      resolve_stmt(stmt);
+   }
+   program[program.root].d = program.add_scope(frames.back().scope);
+   frames.pop_back();
+}
+
+void Resolver::resolve_import(Ast& program) {
+   ast = &program;
+   frames.push_back({nullptr, true});
+   for (auto stmt : program.list(program[program.root].c)) {
+      resolve_stmt(stmt);
+   }
+   frames.pop_back();
+}
+
+// Resolve functions
+
+void Resolver::resolve_stmt(NodeId id) {
+   error::check_stack("Program is nested too deeply.");
+   auto& node = (*ast)[id];
+
+   switch (node.type) {
+   case StmtType::var_decl:
+      resolve_stmt(node.b);
+      break;
+   case StmtType::fn_decl:
+      capture();
+      resolve_fn_decl(id);
+      break;
+   case StmtType::import:
+      capture();
+      resolve_stmt(node.a);
+      break;
+   case StmtType::while_loop:
+   case StmtType::push:
+   case StmtType::type:
+      resolve_stmt(node.a);
+      break;
+   case StmtType::ternary:
+      resolve_stmt(node.a);
+      resolve_stmt(node.b);
+      break;
+   case StmtType::call:
+      node.d = ast->call_sites++;
+      for (auto arg : ast->list(node.c)) {
+         resolve_stmt(arg);
+      }
+      resolve_stmt(node.a);
+      break;
+   case StmtType::command:
+      if (node.a != no_node) {
+         resolve_stmt(node.a);
+      }
+      break;
+   case StmtType::identifier:
+      resolve_identifier(node);
+      break;
+   case StmtType::array:
+      for (auto element : ast->list(node.c)) {
+         resolve_stmt(element);
+      }
+      break;
+   case StmtType::program:
+      resolve_block(id);
+      break;
+   default:
+      break;
+   }
+}
+
+void Resolver::resolve_fn_decl(NodeId id) {
+   auto& decl = (*ast)[id];
+   auto scope = std::make_shared<Scope>();
+
+   // A malformed declaration fails when it runs, so there is nothing to resolve
+
+   if ((*ast)[decl.a].type != StmtType::identifier) {
+      return;
+   }
+
+   auto params = ast->list(decl.c);
+   for (auto param : params) {
+      if ((*ast)[param].type != StmtType::identifier) {
+         return;
+      }
+   }
+
+   for (auto param : params) {
+      auto& ident = (*ast)[param];
+      ident.b = 0;
+      ident.c = scope->add(ident.a);
+   }
+   frames.push_back({scope, false, true});
+
+   auto& body = (*ast)[decl.b];
+   if (body.type == StmtType::program) {
+      auto stmts = ast->list(body.c);
+      for (auto stmt : stmts) {
+         declare(stmt);
+      }
+
+      for (auto stmt : stmts) {
+         resolve_stmt(stmt);
+      }
+   } else {
+      declare(decl.b);
+      resolve_stmt(decl.b);
+   }
+   decl.d = ast->add_scope(scope);
+
+   if (!frames.back().captured) {
+      mark_tail(decl.b);
+   }
+   frames.pop_back();
+}
+
+void Resolver::resolve_block(NodeId id) {
+   auto stmts = ast->list((*ast)[id].c);
+
+   frames.push_back({std::make_shared<Scope>()});
+   for (auto stmt : stmts) {
+      declare(stmt);
+   }
+
+   // A block that neither declares nor imports anything runs in the enclosing environment, so it
+   // gets no scope and the names inside it resolve one level shallower
+
+   if (frames.back().scope->names.empty() && !frames.back().open) {
+      frames.pop_back();
+      for (auto stmt : stmts) {
+         resolve_stmt(stmt);
+      }
+      return;
+   }
+
+   for (auto stmt : stmts) {
+      resolve_stmt(stmt);
+   }
+   (*ast)[id].d = ast->add_scope(frames.back().scope);
+   frames.pop_back();
+}
+
+void Resolver::resolve_identifier(Node& ident) {
+   int depth = 0;
+   for (auto frame = frames.rbegin(); frame != frames.rend(); ++frame, ++depth) {
+      if (frame->scope) {
+         if (auto slot = frame->scope->find(ident.a); slot != -1) {
+            ident.b = depth;
+            ident.c = slot;
+            return;
+         }
+      }
+
+      if (frame->open) {
+         return;
+      }
+   }
+}
+
+void Resolver::mark_tail(NodeId id) {
+   error::check_stack("Program is nested too deeply.");
+   auto& node = (*ast)[id];
+
+   switch (node.type) {
+   case StmtType::call:
+      node.op = tail_call;
+      break;
+   case StmtType::ternary:
+      mark_tail(node.a);
+      mark_tail(node.b);
+      break;
+   case StmtType::program:
+      if (auto stmts = ast->list(node.c); !stmts.empty()) {
+         mark_tail(stmts.back());
+      }
+      break;
+   default:
+      break;
+   }
+}
+
+// Helper functions
+
+// Collects the names a statement declares in the current scope without entering nested blocks or
+// function bodies, which get scopes of their own
+
+void Resolver::declare(NodeId id) {
+   error::check_stack("Program is nested too deeply.");
+   auto& node = (*ast)[id];
+
+   switch (node.type) {
+   case StmtType::var_decl:
+      declare(node.b);
+      declare_name(node.a);
+      break;
+   case StmtType::fn_decl:
+      declare_name(node.a);
+      break;
+   case StmtType::import:
+      frames.back().open = true;
+      declare(node.a);
+      break;
+   case StmtType::while_loop:
+   case StmtType::push:
+   case StmtType::type:
+      declare(node.a);
+      break;
+   case StmtType::ternary:
+      declare(node.a);
+      declare(node.b);
+      break;
+   case StmtType::call:
+      for (auto arg : ast->list(node.c)) {
+         declare(arg);
+      }
+      declare(node.a);
+      break;
+   case StmtType::command:
+      if (node.a != no_node) {
+         declare(node.a);
+      }
+      break;
+   case StmtType::array:
+      for (auto element : ast->list(node.c)) {
+         declare(element);
+      }
+      break;
+   default:
+      break;
+   }
+}
+
+void Resolver::declare_name(NodeId identifier) {
+   auto& ident = (*ast)[identifier];
+   if (ident.type != StmtType::identifier || !frames.back().scope) {
+      return;
+   }
+
+   ident.b = 0;
+   ident.c = frames.back().scope->declare(ident.a);
+}
+
+// Marks the innermost function frame as one that a closure or an imported module may capture
+
+void Resolver::capture() {
+   for (auto frame = frames.rbegin(); frame != frames.rend(); ++frame) {
+      if (frame->function) {
+         frame->captured = true;
+         return;
+      }
+   }
+}
@@ -0,0 +1,228 @@
+#include "serve.hpp"
+
+// Includes
+
+#include "errors.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// Connection
+
+namespace {
+   using Clock = std::chrono::steady_clock;
+
+   constexpr std::uint32_t max_field = 1u << 30;
+
+   // A request has to arrive in full within this time, so that clients that connect and send
+   // nothing do not hold on to the workers
+
+   constexpr auto request_timeout = std::chrono::seconds(10);
+
+   bool read_all(int fd, void* data, std::size_t size, Clock::time_point deadline) {
+      auto bytes = static_cast<char*>(data);
+      while (size > 0) {
+         auto left = std::chrono::ceil<std::chrono::milliseconds>(deadline - Clock::now()).count();
+         pollfd ready {fd, POLLIN, 0};
+         auto polled = (left > 0 ? ::poll(&ready, 1, int(left)) : 0);
+         if (polled < 0 && errno == EINTR) {
+            continue;
+         }
+
+         if (polled <= 0) {
+            return false;
+         }
+
+         auto result = ::read(fd, bytes, size);
+         if (result < 0 && errno == EINTR) {
+            continue;
+         }
+
+         if (result <= 0) {
+            return false;
+         }
+         bytes += result;
+         size -= result;
+      }
+      return true;
+   }
+
+   bool send_all(int fd, const void* data, std::size_t size) {
+      auto bytes = static_cast<const char*>(data);
+      while (size > 0) {
+         auto result = ::send(fd, bytes, size, MSG_NOSIGNAL);
+         if (result < 0 && errno == EINTR) {
+            continue;
+         }
+
+         if (result <= 0) {
+            return false;
+         }
+         bytes += result;
+         size -= result;
+      }
+      return true;
+   }
+
+   bool read_field(int fd, std::string& field, Clock::time_point deadline) {
+      std::uint32_t size;
+      if (!read_all(fd, &size, sizeof(size), deadline) || size > max_field) {
+         return false;
+      }
+      field.resize(size);
+      return read_all(fd, field.data(), size, deadline);
+   }
+
+   bool send_field(int fd, std::string_view data) {
+      std::uint32_t size = data.size();
+      return send_all(fd, &size, sizeof(size)) && send_all(fd, data.data(), size);
+   }
+
+   bool send_output(int fd, std::string_view data) {
+      return send_all(fd, "o", 1) && send_field(fd, data);
+   }
+
+   void send_exit(int fd, const mei::Status& status) {
+      std::int32_t code = status.status;
+      send_all(fd, "x", 1) && send_all(fd, &code, sizeof(code)) && send_field(fd, status.error);
+   }
+
+   // Reads one request, runs it and answers it, output is sent on as the program produces it.
+   // A client that goes away only stops the output, the program itself still runs to its end.
+
+   void handle(int fd, mei::Instance& instance, mei::Cache& programs) {
+      char kind;
+      std::string script, input, source;
+      auto deadline = Clock::now() + request_timeout;
+
+      if (!read_all(fd, &kind, 1, deadline) || !read_field(fd, script, deadline) || !read_field(fd, input, deadline)) {
+         return;
+      }
+
+      mei::Status status;
+      mei::Program program;
+
+      if (kind != 'p' && kind != 's') {
+         status = {1, "Unknown request kind."};
+      } else if (kind == 'p' && !mei::read_file(script, source)) {
+         status = {1, "Could not open '" + script + "'."};
+      } else if (status = programs.get(kind == 'p' ? source : script, program); status.ok()) {
+         bool connected = true;
+         instance.stream([&](std::string_view data) {
+            if (connected && !data.empty()) {
+               connected = send_output(fd, data);
+            }
+         });
+         status = instance.run(program, std::move(input), (kind == 'p' ? script : std::string{}));
+         instance.stream(nullptr);
+         instance.reset();
+      }
+      send_exit(fd, status);
+   }
+
+   // Accepted connections waiting for a free instance
+
+   class Connections {
+      std::mutex mutex;
+      std::condition_variable ready;
+      std::deque<int> fds;
+
+   public:
+      void push(int fd) {
+         {
+            std::lock_guard lock (mutex);
+            fds.push_back(fd);
+         }
+         ready.notify_one();
+      }
+
+      int pop() {
+         std::unique_lock lock (mutex);
+         ready.wait(lock, [&] { return !fds.empty(); });
+         auto fd = fds.front();
+         fds.pop_front();
+         return fd;
+      }
+   };
+
+   int listen_on(const std::string& path) {
+      sockaddr_un address {};
+      address.sun_family = AF_UNIX;
+      if (path.size() >= sizeof(address.sun_path)) {
+         error::fail("Socket path '" + path + "' is too long.");
+      }
+      path.copy(address.sun_path, path.size());
+
+      // Only a socket left behind by a server that is gone is replaced, which is one that refuses
+      // connections. A live server and anything that is not a socket are kept.
+
+      struct stat existing;
+      if (::lstat(path.c_str(), &existing) == 0) {
+         if (!S_ISSOCK(existing.st_mode)) {
+            error::fail("'" + path + "' exists and is not a socket.");
+         }
+
+         auto probe = ::socket(AF_UNIX, SOCK_STREAM, 0);
+         auto connected = (probe >= 0 && ::connect(probe, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0);
+         auto refused = (!connected && errno == ECONNREFUSED);
+         if (probe >= 0) {
+            ::close(probe);
+         }
+
+         if (connected) {
+            error::fail("A server is already listening on '" + path + "'.");
+         }
+         if (!refused) {
+            error::fail("Could not listen on '" + path + "'.");
+         }
+         ::unlink(path.c_str());
+      }
+
+      auto fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+
+      if (fd < 0 || ::bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || ::listen(fd, SOMAXCONN) != 0) {
+         error::fail("Could not listen on '" + path + "'.");
+      }
+      return fd;
+   }
+}
+
+// Functions
+
+namespace serve {
+   [[noreturn]] void run(const std::string& path, const mei::Options& options, unsigned threads) {
+      auto listener = listen_on(path);
+      mei::Cache programs (options);
+      Connections connections;
+
+      std::vector<std::thread> workers;
+      for (unsigned i = 0; i < std::max(1u, threads); ++i) {
+         workers.emplace_back([&] {
+            mei::Instance instance (options);
+            for (;;) {
+               auto fd = connections.pop();
+               handle(fd, instance, programs);
+               ::close(fd);
+            }
+         });
+      }
+
+      for (;;) {
+         auto fd = ::accept(listener, nullptr, nullptr);
+         if (fd >= 0) {
+            connections.push(fd);
+         }
+      }
+   }
+}
@@ -2,49 +2,116 @@
 
 // Includes
 
-#include <stack>
-#include <unordered_map>
+#include "errors.hpp"
+#include <algorithm>
+#include <cstdlib>
 
-std::stack<long> stck;
-std::unordered_map<long, long> registers;
+// State of the calling thread
+
+namespace {
+   constinit thread_local State* current = nullptr;
+}
 
 // Stack
 
 namespace stack {
-   void push(long value) {
-      stck.push(value);
-   }
+   constexpr unsigned long initial_capacity = 1 << 16;
 
-   long top() {
-      return (stck.empty() ? 0 : stck.top());
-   }
+   constinit thread_local Buffer buffer {nullptr, nullptr, nullptr, nullptr};
+   constinit thread_local bool watched = false;
+
+   void grow(unsigned long count) {
+      unsigned long size = buffer.top - buffer.data;
+      if (watched && static_cast<unsigned long>(buffer.capacity - buffer.top) >= count) {
+         buffer.end = buffer.top + count;
+         return;
+      }
+
+      unsigned long capacity = (buffer.data ? (buffer.capacity - buffer.data) * 2 : initial_capacity);
+      while (capacity - size < count) {
+         capacity *= 2;
+      }
+      auto data = static_cast<long*>(std::realloc(buffer.data, capacity * sizeof(long)));
 
-   long pop() {
-      if (stck.empty()) {
-         return 0;
+      if (!data) {
+         error::fail("Out of memory while growing the stack.");
       }
-      long value = stck.top();
-      stck.pop();
-      return value;
+      buffer = {data, data + size, data + (watched ? size + count : capacity), data + capacity};
    }
 
-   unsigned long size() {
-      return stck.size();
+   void watch(bool enable) {
+      watched = enable;
+      buffer.end = (enable ? buffer.top : buffer.capacity);
    }
 
-   bool empty() {
-      return stck.empty();
+   unsigned long high_water() {
+      return buffer.end - buffer.data;
    }
 }
 
 // Registers
 
 namespace reg {
-   void set(long index, long value) {
-      registers[index] = value;
+   constinit thread_local File file {nullptr, 0};
+
+   void set_sparse(long index, long value) {
+      current->sparse[index] = value;
+   }
+
+   long get_sparse(long index) {
+      auto it = current->sparse.find(index);
+      return (it == current->sparse.end() ? 0 : it->second);
    }
 
-   long get(long index) {
-      return registers[index];
+   std::size_t sparse_count() {
+      return current->sparse.size();
    }
 }
+
+// State
+
+State::State(unsigned long registers)
+   : dense(registers) {}
+
+State::~State() {
+   if (current == this) {
+      leave();
+   }
+   std::free(buffer.data);
+}
+
+void State::enter() {
+   if (current) {
+      current->buffer = stack::buffer;
+   }
+   outer = current;
+   current = this;
+   bind();
+}
+
+void State::leave() {
+   buffer = stack::buffer;
+   current = outer;
+
+   if (current) {
+      current->bind();
+   } else {
+      stack::buffer = {nullptr, nullptr, nullptr, nullptr};
+      reg::file = {nullptr, 0};
+   }
+}
+
+void State::bind() {
+   stack::buffer = buffer;
+   reg::file = {dense.data(), dense.size()};
+}
+
+void State::clear() {
+   buffer.top = buffer.data;
+   std::fill(dense.begin(), dense.end(), 0);
+   sparse.clear();
+}
+
+std::vector<long> State::stack() const {
+   return {buffer.data, buffer.top};
+}
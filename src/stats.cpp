@@ -0,0 +1,57 @@
+#include "stats.hpp"
+
+// Includes
+
+#include "stack.hpp"
+#include <algorithm>
+#include <iomanip>
+
+// Stats
+
+namespace stats {
+   constinit thread_local Counters* counters = nullptr;
+
+   void start(Counters& target) {
+      counters = &target;
+      stack::watch(true);
+   }
+
+   void stop() {
+      if (!counters) {
+         return;
+      }
+
+      counters->stack_high_water = std::max(counters->stack_high_water, stack::high_water());
+      counters->sparse_registers = reg::sparse_count();
+      stack::watch(false);
+      counters = nullptr;
+   }
+
+   void Counters::report(std::ostream& out) const {
+      auto flags = out.flags();
+      auto precision = out.precision();
+      out << std::fixed << std::setprecision(3);
+
+      out << "front end:        lex " << lex_time / 1e6 << " ms, parse " << parse_time / 1e6 << " ms\n";
+
+      // Numbers and Nil are stored inline and never allocate
+
+      out << "allocations:      string " << allocations[1] << ", fn " << allocations[2] << ", array " << allocations[3] << '\n';
+
+      out << "environments:     " << environments << " constructed, " << reuses << " reused\n";
+      out << "name lookups:     " << lookups << ", average chain " << (lookups ? double(lookup_steps) / lookups : 0.0)
+          << ", longest " << longest_lookup << '\n';
+
+      out << "slot reads:      ";
+      for (int depth = 0; depth < depths; ++depth) {
+         out << " depth " << depth << (depth == depths - 1 ? "+ " : " ") << slot_reads[depth] << (depth < depths - 1 ? "," : "\n");
+      }
+
+      out << "stack:            high-water mark " << stack_high_water << '\n';
+      out << "registers:        " << sparse_registers << " outside the dense range\n";
+      out << "imports:          " << imports << '\n';
+
+      out.flags(flags);
+      out.precision(precision);
+   }
+}
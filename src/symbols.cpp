@@ -0,0 +1,53 @@
+#include "symbols.hpp"
+
+// Includes
+
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+
+// Symbol table
+
+namespace {
+   struct SymbolTable {
+      std::mutex mutex;
+      std::deque<std::string> names;
+      std::unordered_map<std::string_view, Symbol> ids;
+
+      SymbolTable() {
+         for (auto name : keyword::names) {
+            add(name);
+         }
+      }
+
+      Symbol add(std::string_view name) {
+         auto& stored = names.emplace_back(name);
+         return ids[stored] = names.size() - 1;
+      }
+   };
+
+   SymbolTable& table() {
+      static SymbolTable table;
+      return table;
+   }
+}
+
+// Functions
+
+namespace symbol {
+   Symbol intern(std::string_view name) {
+      auto& symbols = table();
+      std::lock_guard lock (symbols.mutex);
+
+      if (auto it = symbols.ids.find(name); it != symbols.ids.end()) {
+         return it->second;
+      }
+      return symbols.add(name);
+   }
+
+   const std::string& name(Symbol symbol) {
+      auto& symbols = table();
+      std::lock_guard lock (symbols.mutex);
+      return symbols.names[symbol];
+   }
+}
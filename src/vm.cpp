@@ -0,0 +1,482 @@
+#include "vm.hpp"
+
+// Includes
+
+#include "commands.hpp"
+#include "compiler.hpp"
+#include "errors.hpp"
+
+// Dispatch
+//
+// GCC and Clang get a direct threaded dispatch loop through computed goto, every other compiler
+// falls back to a switch inside a loop.
+
+#if defined(__GNUC__)
+#define VM_CASE(name) case Op::name: op_##name
+#define VM_NEXT() goto *labels[std::size_t(ip->op)]
+#else
+#define VM_CASE(name) case Op::name
+#define VM_NEXT() continue
+#endif
+
+#define VM_COMMAND(name, function, type)                           \
+   VM_CASE(name): {                                                \
+      Value final;                                                 \
+      if (!ip->a) {                                                \
+         final = command::function();                              \
+      } else {                                                     \
+         auto times = values.back().as_number();                   \
+         values.pop_back();                                        \
+         final = command::repeat(Type::type, times);               \
+      }                                                            \
+                                                                   \
+      if (!ip->b) {                                                \
+         values.push_back(std::move(final));                       \
+      }                                                            \
+      ++ip;                                                        \
+      VM_NEXT();                                                   \
+   }
+
+#define VM_FUSED(name, call)                                       \
+   VM_CASE(name): {                                                \
+      auto final = command::call;                                  \
+      if (!ip->b) {                                                \
+         values.push_back(std::move(final));                       \
+      }                                                            \
+      ++ip;                                                        \
+      VM_NEXT();                                                   \
+   }
+
+// VM
+
+VM::VM(bool fuse, bool import_once, std::size_t recursion_memory)
+   : memory_limit(recursion_memory), importer(fuse, import_once) {}
+
+// Evaluation functions
+
+Value VM::run(const Ast& program, Environment& env) {
+   auto chunk = std::make_unique<Chunk>();
+   Compiler compiler (*chunk, program);
+   compiler.compile();
+
+   modules.push_back(std::move(chunk));
+   return execute(*modules.back(), env);
+}
+
+void VM::source(const std::string& path) {
+   importer.root(path);
+}
+
+Value VM::execute(const Chunk& entry, Environment& frame) {
+#if defined(__GNUC__)
+   static void* labels[] = {
+#define MEI_OPCODE(name) &&op_##name,
+      MEI_OPCODES(MEI_OPCODE)
+#undef MEI_OPCODE
+   };
+   static_assert(sizeof(labels) / sizeof(labels[0]) == std::size_t(Op::count));
+#endif
+
+   auto base = values.size();
+   auto scope_base = scopes.size();
+   auto frame_base = frames.size();
+   Environment* locals = &frame;
+   Environment* env = locals;
+   const Chunk* chunk = &entry;
+   const Instruction* code = chunk->code.data();
+   const Instruction* ip = code;
+
+   auto restore_scopes = [&](std::size_t count) {
+      while (scopes.size() > count) {
+         release(std::move(scopes.back()));
+         scopes.pop_back();
+      }
+      env = (scopes.size() > scope_base ? scopes.back().get() : locals);
+   };
+
+   // Pops the frame of the running function and continues in its caller at the call instruction
+
+   auto leave = [&]() {
+      auto& top = frames.back();
+      restore_scopes(scope_base);
+      memory -= top.memory;
+      release(std::move(top.env));
+
+      chunk = top.chunk;
+      code = chunk->code.data();
+      ip = top.ip;
+      base = top.base;
+      scope_base = top.scope_base;
+      locals = top.locals;
+      frames.pop_back();
+      env = (scopes.size() > scope_base ? scopes.back().get() : locals);
+   };
+
+   // Routes a 'Break' or 'Continue' raised by a callee to the enclosing loop, returns false when
+   // there is no enclosing loop in this chunk and it has to be propagated further up
+
+   auto handle_flow = [&](std::int32_t index) {
+      if (index < 0) {
+         return false;
+      }
+
+      auto& handler = chunk->handlers[index];
+      values.resize(base + handler.depth);
+      restore_scopes(scope_base + handler.scopes);
+      values.push_back(Null::make());
+      ip = code + (flow == Flow::brk ? handler.break_target : handler.continue_target);
+      flow = Flow::normal;
+      return true;
+   };
+
+dispatch:
+   for (;;) {
+      switch (ip->op) {
+      // Values
+
+      VM_CASE(push_const):
+         values.push_back(chunk->constants[ip->a]);
+         ++ip;
+         VM_NEXT();
+
+      VM_CASE(push_nil):
+         values.push_back(Null::make());
+         ++ip;
+         VM_NEXT();
+
+      VM_CASE(pop):
+         values.pop_back();
+         ++ip;
+         VM_NEXT();
+
+      VM_CASE(drop):
+         values.resize(values.size() - ip->a);
+         ++ip;
+         VM_NEXT();
+
+      VM_CASE(load):
+         values.push_back(env->get(Symbol(ip->a)));
+         ++ip;
+         VM_NEXT();
+
+      VM_CASE(load_slot):
+         values.push_back(env->get(ip->a, ip->b, Symbol(ip->c)));
+         ++ip;
+         VM_NEXT();
+
+      VM_CASE(define):
+         env->set(Symbol(ip->a), values.back());
+         ++ip;
+         VM_NEXT();
+
+      VM_CASE(define_slot):
+         env->set_slot(ip->b, values.back());
+         ++ip;
+         VM_NEXT();
+
+      VM_CASE(make_fn): {
+         auto& proto = *chunk->functions[ip->a];
+         values.push_back(Fn::make(proto.identifier, proto.params, proto.scope, env, nullptr, no_node, &proto.chunk));
+         ++ip;
+         VM_NEXT();
+      }
+
+      VM_CASE(make_array): {
+         std::vector<Value> array (values.end() - ip->a, values.end());
+         values.resize(values.size() - ip->a);
+         values.push_back(Array::make(std::move(array)));
+         ++ip;
+         VM_NEXT();
+      }
+
+      // Scopes and control flow
+
+      VM_CASE(enter_scope):
+         scopes.push_back(acquire(env, chunk->scopes[ip->a].get()));
+         env = scopes.back().get();
+         ++ip;
+         VM_NEXT();
+
+      VM_CASE(exit_scope):
+         restore_scopes(scopes.size() - ip->a);
+         ++ip;
+         VM_NEXT();
+
+      VM_CASE(loop_enter):
+         ++loops;
+         ++ip;
+         VM_NEXT();
+
+      VM_CASE(loop_exit):
+         --loops;
+         ++ip;
+         VM_NEXT();
+
+      VM_CASE(loop_test):
+         ip = (stack::empty() || !stack::pop() ? code + ip->a : ip + 1);
+         VM_NEXT();
+
+      VM_CASE(branch):
+         ip = (!stack::empty() && stack::pop() ? ip + 1 : code + ip->a);
+         VM_NEXT();
+
+      VM_CASE(jump):
+         ip = code + ip->a;
+         VM_NEXT();
+
+      VM_CASE(break_dyn):
+         if (loops == 0) {
+            error::fail("'BreakStmt' outside of a loop.");
+         }
+         flow = Flow::brk;
+         goto unwind;
+
+      VM_CASE(continue_dyn):
+         if (loops == 0) {
+            error::fail("'ContinueStmt' outside of a loop.");
+         }
+         flow = Flow::cont;
+         goto unwind;
+
+      VM_CASE(call): {
+         auto func = std::move(values.back());
+         values.pop_back();
+
+         auto& fn = callable(func, ip->a);
+         auto callee = acquire(fn.env, fn.scope.get());
+         auto args = values.size() - ip->a;
+         for (std::size_t i = 0; i < fn.params.size(); ++i) {
+            callee->set_slot(i, std::move(values[args + i]));
+         }
+         values.resize(args);
+
+         auto cost = sizeof(Frame) + callee->memory();
+         if (memory + cost + values.size() * sizeof(Value) > memory_limit) {
+            error::fail("Recursion limit exceeded.");
+         }
+         memory += cost;
+
+         frames.push_back({chunk, ip, base, scope_base, locals, std::move(callee), cost});
+         locals = env = frames.back().env.get();
+         base = values.size();
+         scope_base = scopes.size();
+
+         chunk = fn.code;
+         code = chunk->code.data();
+         ip = code;
+         VM_NEXT();
+      }
+
+      // Rebinds the current frame to the callee and continues in its chunk, the resolver only
+      // marks calls whose frame nothing can have captured
+
+      VM_CASE(tail_call): {
+         auto func = std::move(values.back());
+         values.pop_back();
+
+         auto& fn = callable(func, ip->a);
+         auto args = values.size() - ip->a;
+         locals->reset(fn.env, fn.scope.get());
+
+         for (std::size_t i = 0; i < fn.params.size(); ++i) {
+            locals->set_slot(i, std::move(values[args + i]));
+         }
+         values.resize(base);
+         restore_scopes(scope_base);
+
+         if (frames.size() > frame_base) {
+            auto& top = frames.back();
+            memory -= top.memory;
+            top.memory = sizeof(Frame) + locals->memory();
+            memory += top.memory;
+         }
+
+         chunk = fn.code;
+         code = chunk->code.data();
+         ip = code;
+         VM_NEXT();
+      }
+
+      VM_CASE(import):
+         values.back() = import(*env, values.back().as_string(), chunk->bundle);
+
+         if (flow != Flow::normal) {
+            if (!handle_flow(ip->b)) {
+               goto unwind;
+            }
+            VM_NEXT();
+         }
+         ++ip;
+         VM_NEXT();
+
+      VM_CASE(ret): {
+         auto result = std::move(values.back());
+         values.resize(base);
+
+         if (frames.size() == frame_base) {
+            return result;
+         }
+         leave();
+         values.push_back(std::move(result));
+         ++ip;
+         VM_NEXT();
+      }
+
+      VM_CASE(error):
+         error::fail(chunk->constants[ip->a].as_string());
+
+      // Statements
+
+      VM_CASE(push):
+         command::push_to_stack(values.back());
+         ++ip;
+         VM_NEXT();
+
+      VM_CASE(type): {
+         auto result = long(values.back().type);
+         stack::push(result);
+         values.back() = NumberValue::make(result);
+         ++ip;
+         VM_NEXT();
+      }
+
+      VM_CASE(pull):
+         if (stack::empty()) {
+            error::fail("'#': Expected stack to not be empty.");
+         }
+         values.push_back(NumberValue::make(stack::pop()));
+         ++ip;
+         VM_NEXT();
+
+      // Commands
+
+      VM_COMMAND(read_number, read_number, tilde)
+      VM_COMMAND(read_key, read_key, grave)
+      VM_COMMAND(logical_not, logical_not, exclamation)
+      VM_COMMAND(drop_stack, drop, dollar)
+      VM_COMMAND(modulo, modulo, percent)
+      VM_COMMAND(square_root, square_root, caret)
+      VM_COMMAND(read_line, read_line, ampersand)
+      VM_COMMAND(multiply, multiply, asterisk)
+      VM_COMMAND(subtract, subtract, hyphen)
+      VM_COMMAND(add, add, plus)
+      VM_COMMAND(equal, equal, equal)
+      VM_COMMAND(swap, swap, backslash)
+      VM_COMMAND(duplicate, duplicate, colon)
+      VM_COMMAND(negate, negate, apostrophe)
+      VM_COMMAND(print_char, print_char, comma)
+      VM_COMMAND(less, less, less)
+      VM_COMMAND(greater, greater, greater)
+      VM_COMMAND(print_number, print_number, period)
+      VM_COMMAND(divide, divide, slash)
+      VM_COMMAND(size, size, size)
+      VM_COMMAND(set_register, set_register, set_reg)
+      VM_COMMAND(get_register, get_register, get_reg)
+      VM_COMMAND(logical_or, logical_or, lor)
+      VM_COMMAND(logical_and, logical_and, land)
+
+      // Fused commands
+
+      VM_FUSED(dup_multiply, dup_multiply())
+      VM_FUSED(swap_subtract, swap_subtract())
+      VM_FUSED(equal_not, equal_not())
+      VM_FUSED(push_add, push_add(ip->a))
+      VM_FUSED(push_subtract, push_subtract(ip->a))
+      VM_FUSED(push_multiply, push_multiply(ip->a))
+      VM_FUSED(push_divide, push_divide(ip->a))
+      VM_FUSED(push_modulo, push_modulo(ip->a))
+      VM_FUSED(push_equal, push_equal(ip->a))
+      VM_FUSED(push_less, push_less(ip->a))
+      VM_FUSED(push_greater, push_greater(ip->a))
+
+      VM_CASE(exit):
+      VM_CASE(unknown): {
+         long times = 1;
+         if (ip->a) {
+            times = values.back().as_number();
+            values.pop_back();
+         }
+
+         if (times > 0) {
+            if (ip->op == Op::exit) {
+               command::exit();
+            }
+            command::unknown(Type(ip->b));
+         }
+
+         if (ip->op == Op::unknown || !ip->b) {
+            values.push_back(Null::make());
+         }
+         ++ip;
+         VM_NEXT();
+      }
+
+      case Op::count:
+         break;
+      }
+   }
+
+   // A 'Break' or 'Continue' without an enclosing loop in the running chunk pops frames until a
+   // call site inside a loop handles it, or leaves it to whoever called 'execute'
+
+unwind:
+   values.resize(base);
+   if (frames.size() > frame_base) {
+      leave();
+      if (handle_flow(ip->b)) {
+         goto dispatch;
+      }
+      goto unwind;
+   }
+   restore_scopes(scope_base);
+   return Null::make();
+}
+
+// Helper functions
+
+const Fn& VM::callable(const Value& func, std::size_t count) {
+   if (func.type != ValueType::fn) {
+      error::fail("Only functions are callable.");
+   }
+
+   auto& fn = func.as<Fn>();
+   if (count != fn.params.size()) {
+      error::fail("Function parameter count does not match call expression argument count.");
+   }
+   return fn;
+}
+
+std::unique_ptr<Environment> VM::acquire(Environment* parent, const Scope* scope) {
+   if (spare.empty()) {
+      return std::make_unique<Environment>(parent, scope);
+   }
+
+   auto env = std::move(spare.back());
+   spare.pop_back();
+   env->reset(parent, scope);
+   return env;
+}
+
+void VM::release(std::unique_ptr<Environment> env) {
+   if (spare.size() < max_spare) {
+      spare.push_back(std::move(env));
+   }
+}
+
+Value VM::import(Environment& env, const std::string& code, const std::shared_ptr<const Bundle>& bundle) {
+   auto module = importer.enter(code, bundle);
+   if (!module) {
+      return Null::make();
+   }
+
+   auto& chunk = imports[module];
+   if (!chunk) {
+      chunk = std::make_unique<Chunk>();
+      Compiler compiler (*chunk, *module->program);
+      compiler.compile();
+   }
+
+   auto result = execute(*chunk, env);
+   importer.leave();
+   return result;
+}